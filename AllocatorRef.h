@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace Allocators {
+
+// Аллокаторы, которые возвращают память только целиком (Reset), объявляют
+// is_monotonic. Узлы такой памяти бросаются без деструкторов, поэтому
+// ссылка на аллокатор из них не должна держать его счётчик.
+template <typename Allocator, typename = void>
+struct IsMonotonic : std::false_type {};
+
+template <typename Allocator>
+struct IsMonotonic<Allocator, std::void_t<typename Allocator::is_monotonic>> : Allocator::is_monotonic {};
+
+// Ссылка на байтовый аллокатор контейнера. Копируется и rebind'ится,
+// поэтому подходит для std::allocate_shared: узел и счётчик ссылок
+// получают один общий блок из пула контейнера. Ссылка владеет аллокатором
+// совместно: блок со счётчиком освобождается, когда умирает последний
+// weak_ptr (например, итератор), и пул должен дожить до этого момента.
+template <typename T, typename ByteAllocator>
+class AllocatorRef {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <class V>
+    struct rebind {
+        using other = AllocatorRef<V, ByteAllocator>;
+    };
+
+    explicit AllocatorRef(std::shared_ptr<ByteAllocator> base)
+    : base_(IsMonotonic<ByteAllocator>::value ? std::shared_ptr<ByteAllocator>(std::shared_ptr<ByteAllocator>(), base.get())
+                                              : std::move(base)) {}
+
+    template <class V>
+    AllocatorRef(const AllocatorRef<V, ByteAllocator>& other)
+    : base_(other.base_) {}
+
+    T* allocate(size_t count) {
+        return reinterpret_cast<T*>(base_->allocate(Bytes(count)));
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        base_->deallocate(reinterpret_cast<char*>(ptr), Bytes(count));
+    }
+
+    template <class V>
+    bool operator == (const AllocatorRef<V, ByteAllocator>& other) const {
+        return base_ == other.base_;
+    }
+
+    template <class V>
+    bool operator != (const AllocatorRef<V, ByteAllocator>& other) const {
+        return !(*this == other);
+    }
+
+private:
+    template <typename V, typename B>
+    friend class AllocatorRef;
+
+    // Пул выдаёт блоки подряд, поэтому размер округляется до максимального
+    // выравнивания, чтобы следующий блок тоже был выровнен.
+    static size_t Bytes(size_t count) {
+        const size_t align = alignof(std::max_align_t);
+        return (count * sizeof(T) + align - 1) / align * align;
+    }
+
+    std::shared_ptr<ByteAllocator> base_;
+};
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "Tree.h"
+
+namespace Allocators {
+
+// Пул, выдающий вместо указателей перемещаемые дескрипторы. Адрес блока
+// получается через Resolve() и может меняться после Compact(), который
+// сдвигает занятые блоки к началу пула и собирает свободное место в один
+// блок. Контейнер хранит дескрипторы и сам ничего не исправляет (так устроен
+// HandleTree); тем, кто кэширует адреса, уведомление о переносе приходит
+// через relocation hook.
+template <size_t MEM_SIZE>
+class CompactingPool {
+public:
+    using handle_type = uint32_t;
+    using relocation_hook = std::function<void(handle_type, void*)>;
+
+    static constexpr handle_type kNullHandle = UINT32_MAX;
+    static constexpr size_t kAlign = 16;
+    static constexpr size_t kCompactStep = 4096;
+
+    CompactingPool() {
+        pool_ = (char*) std::aligned_alloc(kAlign, Size());
+        if (pool_ == nullptr) {
+            throw std::bad_alloc();
+        }
+        free_blocks_.Insert(0, Size());
+    }
+
+    ~CompactingPool() {
+        std::free(pool_);
+    }
+
+    CompactingPool(const CompactingPool&) = delete;
+    CompactingPool(CompactingPool&&) = delete;
+
+    // Если подходящего блока нет, а свободного места в сумме хватает,
+    // пул уплотняется порциями по kCompactStep байт, пока блок не найдётся.
+    handle_type Allocate(size_t alloc_size) {
+        if (alloc_size == 0) {
+            throw std::logic_error("Allocation of 0 bytes");
+        }
+        alloc_size = AlignUp(alloc_size);
+        auto iter = FirstFit(alloc_size);
+        while (iter == free_blocks_.end() && FreeBytes() >= alloc_size && Compact(kCompactStep) != 0) {
+            iter = FirstFit(alloc_size);
+        }
+        if (iter == free_blocks_.end()) {
+            throw std::bad_alloc();
+        }
+        size_t offset = (*iter).first;
+        size_t block_size = (*iter).second;
+        free_blocks_.Erase(iter);
+        if (block_size != alloc_size) {
+            free_blocks_.Insert(offset + alloc_size, block_size - alloc_size);
+        }
+        free_bytes_ -= alloc_size;
+
+        handle_type handle;
+        if (free_handles_.empty()) {
+            handle = static_cast<handle_type>(handles_.size());
+            handles_.push_back({offset, alloc_size});
+        } else {
+            handle = free_handles_.back();
+            free_handles_.pop_back();
+            handles_[handle] = {offset, alloc_size};
+        }
+        busy_blocks_.emplace(offset, handle);
+        return handle;
+    }
+
+    void Free(handle_type handle) {
+        if (handle >= handles_.size() || handles_[handle].size == 0) {
+            throw std::logic_error("Wrong handle to free");
+        }
+        size_t offset = handles_[handle].offset;
+        size_t size = handles_[handle].size;
+        busy_blocks_.erase(offset);
+        handles_[handle] = {0, 0};
+        free_handles_.push_back(handle);
+        free_bytes_ += size;
+        InsertFree(offset, size);
+    }
+
+    void* Resolve(handle_type handle) const {
+        return pool_ + handles_[handle].offset;
+    }
+
+    template <typename T>
+    T* Get(handle_type handle) const {
+        return reinterpret_cast<T*>(Resolve(handle));
+    }
+
+    void SetRelocationHook(relocation_hook hook) {
+        hook_ = std::move(hook);
+    }
+
+    // Переносит занятые блоки к началу пула, пока не перенесёт хотя бы
+    // max_bytes или пока свободное место не окажется одним блоком в конце.
+    // Возвращает число перенесённых байт.
+    size_t Compact(size_t max_bytes) {
+        size_t moved = 0;
+        while (moved < max_bytes && !free_blocks_.Empty()) {
+            auto hole = free_blocks_.begin();
+            size_t hole_offset = (*hole).first;
+            size_t hole_size = (*hole).second;
+            auto busy = busy_blocks_.find(hole_offset + hole_size);
+            if (busy == busy_blocks_.end()) {
+                break;
+            }
+            handle_type handle = busy->second;
+            size_t size = handles_[handle].size;
+            std::memmove(pool_ + hole_offset, pool_ + hole_offset + hole_size, size);
+
+            // перед дырой занятых блоков нет, порядок не меняется и узел
+            // переносится без выделения памяти
+            auto moved_block = busy_blocks_.extract(busy);
+            moved_block.key() = hole_offset;
+            busy_blocks_.insert(std::move(moved_block));
+            handles_[handle].offset = hole_offset;
+            free_blocks_.Erase(hole);
+            InsertFree(hole_offset + size, hole_size);
+            moved += size;
+            if (hook_) {
+                hook_(handle, pool_ + hole_offset);
+            }
+        }
+        return moved;
+    }
+
+    size_t FreeBytes() const {
+        return free_bytes_;
+    }
+
+    size_t FreeBlocks() const {
+        return free_blocks_.Size();
+    }
+
+    size_t LargestFreeBlock() {
+        size_t result = 0;
+        for (auto pair : free_blocks_) {
+            result = std::max(result, pair.second);
+        }
+        return result;
+    }
+
+    // Доля свободной памяти, недоступной одним блоком: 0 — всё свободное
+    // место подряд, близко к 1 — оно раздроблено.
+    double Fragmentation() {
+        if (free_bytes_ == 0) {
+            return 0;
+        }
+        return 1.0 - double(LargestFreeBlock()) / free_bytes_;
+    }
+
+    static constexpr size_t Size() {
+        return MEM_SIZE / kAlign * kAlign;
+    }
+
+private:
+    struct HandleEntry {
+        size_t offset;
+        size_t size;
+    };
+
+    static size_t AlignUp(size_t size) {
+        return (size + kAlign - 1) / kAlign * kAlign;
+    }
+
+    TreeIterator<size_t, size_t> FirstFit(size_t alloc_size) {
+        auto iter = free_blocks_.begin();
+        while (iter != free_blocks_.end() && (*iter).second < alloc_size) {
+            ++iter;
+        }
+        return iter;
+    }
+
+    // Добавляет свободный блок, сливая его с соседями.
+    void InsertFree(size_t offset, size_t size) {
+        auto next = free_blocks_.Find(offset + size);
+        if (next != free_blocks_.end()) {
+            size += (*next).second;
+            free_blocks_.Erase(next);
+        }
+        auto inserted = free_blocks_.Insert(offset, size);
+        if (inserted != free_blocks_.begin()) {
+            auto prev = std::prev(inserted);
+            if ((*prev).first + (*prev).second == offset) {
+                (*prev).second += size;
+                free_blocks_.Erase(inserted);
+            }
+        }
+    }
+
+    Tree<size_t, size_t> free_blocks_;
+    // Занятые блоки по смещению. Блоки выделяются и переносятся по
+    // возрастанию адресов, и несбалансированный Tree выродился бы здесь в
+    // список, а каждый перенос в Compact() стал бы O(n).
+    std::map<size_t, handle_type> busy_blocks_;
+    std::vector<HandleEntry> handles_;
+    std::vector<handle_type> free_handles_;
+    size_t free_bytes_ = Size();
+    relocation_hook hook_;
+    char* pool_;
+};
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "Square.h"
+#include "Stats.h"
+
+// Хранилище квадратов с точки зрения команд. Протокол add/erase/size/count/
+// print/stats разбирается один раз в ExecuteFigureCommand, а хранилища
+// (FigureStore в памяти, MappedFigureStore в файле) реализуют только эти
+// операции. Блокировки — забота хранилища, до вызова ExecuteFigureCommand.
+class FigureBackend {
+public:
+    using figure_type = Square<int>;
+
+    virtual ~FigureBackend() = default;
+
+    virtual bool Contains(int key) = 0;
+    // Бросает исключение, если фигуру не удалось сохранить.
+    virtual void Add(int key, const figure_type& figure) = 0;
+    virtual bool Erase(int key) = 0;
+    virtual size_t Size() = 0;
+    virtual size_t CountSmaller(double area) = 0;
+    // Обход по возрастанию ключей.
+    virtual void ForEach(const std::function<void(int, const figure_type&)>& function) = 0;
+    virtual void PrintStats(std::ostream& os) = 0;
+};
+
+// Отсутствующий аргумент не должен молча становиться нулём: в строчном
+// протоколе сервера "erase" без ключа удалял бы фигуру 0.
+template <typename T>
+bool ReadArgument(std::istream& is, std::ostream& os, T& value) {
+    if (is >> value) {
+        return true;
+    }
+    os << "Missing or invalid argument\n";
+    is.clear();
+    is.ignore(32767, '\n');
+    return false;
+}
+
+// Выполняет команду, аргументы читаются из is, ответ пишется в os.
+inline void ExecuteFigureCommand(FigureBackend& figures, const std::string& command, std::istream& is, std::ostream& os) {
+    if (command == "add") {
+        STATS_TIMER("command.add");
+        int key;
+        if (!ReadArgument(is, os, key)) {
+            return;
+        }
+        bool exists;
+        {
+            STATS_TIMER("add.find");
+            exists = figures.Contains(key);
+        }
+        if (exists) {
+            os << "Element with such key already exists\n";
+            return;
+        }
+        try {
+            FigureBackend::figure_type new_figure;
+            {
+                STATS_TIMER("add.scan");
+                is >> new_figure;
+                if (!is) {
+                    throw std::invalid_argument("Missing argument");
+                }
+            }
+            {
+                STATS_TIMER("add.insert");
+                figures.Add(key, new_figure);
+            }
+            os << new_figure << "\n";
+        } catch (std::exception& ex) {
+            if (is) {
+                os << ex.what() << "\n";
+            } else {
+                // Scan строит квадрат и из недочитанных точек, поэтому
+                // его ошибка тут вторична
+                os << "Missing or invalid argument\n";
+                is.clear();
+                is.ignore(32767, '\n');
+            }
+        }
+    } else if (command == "erase") {
+        STATS_TIMER("command.erase");
+        int key;
+        if (!ReadArgument(is, os, key)) {
+            return;
+        }
+        if (!figures.Erase(key)) {
+            os << "No such element in container\n";
+        }
+    } else if (command == "size") {
+        STATS_TIMER("command.size");
+        os << figures.Size() << "\n";
+    } else if (command == "count") {
+        STATS_TIMER("command.count");
+        size_t required_area;
+        if (!ReadArgument(is, os, required_area)) {
+            return;
+        }
+        os << figures.CountSmaller(required_area);
+    } else if (command == "print") {
+        STATS_TIMER("command.print");
+        figures.ForEach([&os] (int key, const FigureBackend::figure_type& figure) {
+            os << "(" << key << ", " << figure << ") ";
+        });
+    } else if (command == "stats") {
+        figures.PrintStats(os);
+    } else {
+        os << "Incorrect command\n";
+        is.ignore(32767, '\n');
+    }
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "FigureStore.h"
+
+// Сервер протокола FigureStore на Unix-сокете. Каждый поток ведёт свой
+// epoll и сам принимает соединения. Запрос — одна строка, ответ — одна
+// строка. Клиент может отправлять запросы пачкой, не дожидаясь ответов:
+// всё, что пришло за одно чтение, выполняется подряд, а ответы уходят
+// одной записью.
+class FigureServer {
+public:
+    FigureServer(FigureStore& store, const std::string& path, size_t threads = std::thread::hardware_concurrency())
+    : store_(store), path_(path), threads_(threads == 0 ? 1 : threads) {
+        listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            close(listener_);
+            throw std::logic_error("Socket path too long");
+        }
+        path.copy(addr.sun_path, path.size());
+        unlink(path.c_str());
+        if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || listen(listener_, SOMAXCONN) != 0) {
+            int error = errno;
+            close(listener_);
+            throw std::system_error(error, std::generic_category(), "bind " + path);
+        }
+    }
+
+    ~FigureServer() {
+        close(listener_);
+        unlink(path_.c_str());
+    }
+
+    FigureServer(const FigureServer&) = delete;
+    FigureServer(FigureServer&&) = delete;
+
+    // Обслуживает клиентов, пока stop не станет true.
+    void Run(const std::atomic<bool>& stop) {
+        std::vector<std::thread> loops;
+        for (size_t i = 1; i < threads_; ++i) {
+            loops.emplace_back([this, &stop] { EventLoop(stop); });
+        }
+        EventLoop(stop);
+        for (auto& loop : loops) {
+            loop.join();
+        }
+    }
+
+private:
+    struct Connection {
+        std::string input;
+        std::string output;
+        size_t written = 0;
+        bool waiting_write = false;
+    };
+
+    void EventLoop(const std::atomic<bool>& stop) {
+        int epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_create1");
+        }
+        epoll_event listen_event{};
+        listen_event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        listen_event.data.fd = listener_;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener_, &listen_event);
+
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        std::vector<epoll_event> events(64);
+        while (!stop) {
+            int ready = epoll_wait(epoll, events.data(), events.size(), 200);
+            if (ready < 0 && errno != EINTR) {
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listener_) {
+                    Accept(epoll, connections);
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    continue;
+                }
+                bool alive = !(events[i].events & (EPOLLERR | EPOLLHUP)) || (events[i].events & EPOLLIN);
+                if (alive && (events[i].events & EPOLLIN)) {
+                    alive = Read(fd, *it->second);
+                }
+                if (alive) {
+                    alive = Flush(epoll, fd, *it->second);
+                }
+                if (!alive) {
+                    close(fd);
+                    connections.erase(it);
+                }
+            }
+        }
+        for (auto& connection : connections) {
+            close(connection.first);
+        }
+        close(epoll);
+    }
+
+    void Accept(int epoll, std::unordered_map<int, std::unique_ptr<Connection>>& connections) {
+        while (true) {
+            int fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+            connections[fd] = std::make_unique<Connection>();
+        }
+    }
+
+    bool Read(int fd, Connection& connection) {
+        char buffer[4096];
+        bool closed = false;
+        while (true) {
+            ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count > 0) {
+                connection.input.append(buffer, count);
+            } else if (count == 0) {
+                closed = true;
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            } else {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    return false;
+                }
+                break;
+            }
+        }
+
+        size_t begin = 0;
+        size_t end;
+        while ((end = connection.input.find('\n', begin)) != std::string::npos) {
+            Execute(connection.input.substr(begin, end - begin), connection.output);
+            begin = end + 1;
+        }
+        connection.input.erase(0, begin);
+        if (closed) {
+            Flush(-1, fd, connection);
+        }
+        return !closed;
+    }
+
+    void Execute(const std::string& line, std::string& output) {
+        std::istringstream is(line);
+        std::ostringstream os;
+        std::string command;
+        if (!(is >> command)) {
+            // на каждую строку ровно один ответ, иначе клиент с конвейером
+            // собьётся со счёта
+            output += "Empty command\n";
+            return;
+        }
+        store_.Execute(command, is, os);
+        std::string response = os.str();
+        if (!response.empty() && response.back() == '\n') {
+            response.pop_back();
+        }
+        for (size_t pos = 0; (pos = response.find('\n', pos)) != std::string::npos; ) {
+            response.replace(pos, 1, "; ");
+        }
+        response.push_back('\n');
+        output += response;
+    }
+
+    // Пишет накопленные ответы. Если сокет переполнен, ждёт EPOLLOUT.
+    bool Flush(int epoll, int fd, Connection& connection) {
+        while (connection.written < connection.output.size()) {
+            ssize_t count = send(fd, connection.output.data() + connection.written,
+                                 connection.output.size() - connection.written, MSG_NOSIGNAL);
+            if (count > 0) {
+                connection.written += count;
+            } else if (count < 0 && errno == EINTR) {
+                continue;
+            } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (epoll >= 0 && !connection.waiting_write) {
+                    Watch(epoll, fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+                    connection.waiting_write = true;
+                }
+                return true;
+            } else {
+                return false;
+            }
+        }
+        if (epoll >= 0 && connection.waiting_write) {
+            Watch(epoll, fd, EPOLLIN | EPOLLRDHUP);
+            connection.waiting_write = false;
+        }
+        connection.output.clear();
+        connection.written = 0;
+        return true;
+    }
+
+    static void Watch(int epoll, int fd, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    FigureStore& store_;
+    std::string path_;
+    size_t threads_;
+    int listener_ = -1;
+};
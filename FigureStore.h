@@ -0,0 +1,144 @@
+#pragma once
+
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+
+#include "FigureCommands.h"
+#include "PersistentTree.h"
+#include "Square.h"
+#include "Stats.h"
+#include "Tree.h"
+#include "TreeAllocator.h"
+
+// Хранилище квадратов в памяти. Команды изменения выполняются по одной.
+// size/count/print работают со снимком PersistentTree без блокировки и не
+// задерживают add/erase; снимок хранит копии квадратов, поэтому erase не
+// освобождает то, что читают другие.
+class FigureStore : private FigureBackend {
+public:
+    using tree_type = Tree<int, Square<int>*, Allocators::TreeAllocator<Square<int>, 4096>>;
+    // Зеркало для снимков выделяет узлы в куче, а не в пуле: пул ограничивает
+    // число квадратов, и зеркало этого предела не обходит — в нём те же
+    // ключи, что и в figures_, плюс копии путей, которые держат ещё не
+    // закончившиеся чтения. В общем пуле эти копии отнимали бы место у
+    // квадратов, и add отказывал бы из-за медленного читателя, а не из-за
+    // заполненного пула; каждый узел зеркала к тому же печатался бы в
+    // трассировке аллокатора.
+    using snapshot_tree_type = PersistentTree<int, Square<int>>;
+
+    // Поиск по ключу в add и erase идёт через хэш-индекс дерева. Индекс
+    // живёт в том же пуле, и пул в 4096 байт нужен именно ради него: с
+    // индексом помещается 28 квадратов против 41 без него. Предел задаёт
+    // рост таблицы с 32 до 64 ячеек, когда старый и новый массивы должны
+    // одновременно найти место в пуле first-fit.
+    FigureStore() {
+        figures_.EnableIndex();
+    }
+
+    FigureStore(const FigureStore&) = delete;
+    FigureStore(FigureStore&&) = delete;
+
+    ~FigureStore() {
+        for (auto i : figures_) {
+            delete i.second;
+        }
+    }
+
+    static bool IsWrite(const std::string& command) {
+        return command == "add" || command == "erase";
+    }
+
+    static bool IsSnapshotRead(const std::string& command) {
+        return command == "size" || command == "count" || command == "print";
+    }
+
+    // Выполняет команду, аргументы читаются из is, ответ пишется в os.
+    void Execute(const std::string& command, std::istream& is, std::ostream& os) {
+        if (IsWrite(command)) {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            ExecuteFigureCommand(*this, command, is, os);
+        } else if (IsSnapshotRead(command)) {
+            ExecuteFigureCommand(*this, command, is, os);
+        } else {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            ExecuteFigureCommand(*this, command, is, os);
+        }
+    }
+
+    void PrintStats(std::ostream& os) override {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        PrintStatsLocked(os);
+    }
+
+private:
+    void PrintStatsLocked(std::ostream& os) {
+        os << "tree.size " << figures_.Size() << "\n"
+           << "tree.depth " << figures_.Depth() << "\n";
+        if (STATS_ENABLED) {
+            Stats::Registry::Instance().Print(os);
+        } else {
+            os << "instrumentation disabled, build with FIGURE_STATS\n";
+        }
+    }
+
+    // Операции для ExecuteFigureCommand; Execute уже взял нужную блокировку.
+    bool Contains(int key) override {
+        return figures_.Find(key) != figures_.end();
+    }
+
+    void Add(int key, const figure_type& figure) override {
+        Square<int>* new_figure;
+        {
+            STATS_TIMER("add.new");
+            new_figure = new Square<int>(figure);
+        }
+        try {
+            auto inserted = figures_.Insert(key, new_figure);
+            try {
+                snapshots_.Insert(key, figure);
+            } catch (...) {
+                figures_.Erase(inserted);
+                throw;
+            }
+        } catch (...) {
+            delete new_figure;
+            throw;
+        }
+    }
+
+    bool Erase(int key) override {
+        auto it = figures_.Find(key);
+        if (it == figures_.end()) {
+            return false;
+        }
+        // снимок меняется первым: его Erase выделяет память и может
+        // бросить, Erase дерева — нет
+        snapshots_.Erase(key);
+        delete (*it).second;
+        figures_.Erase(it);
+        return true;
+    }
+
+    size_t Size() override {
+        return snapshots_.Snapshot().Size();
+    }
+
+    size_t CountSmaller(double area) override {
+        return snapshots_.Snapshot().ParallelCountIf([area] (std::pair<const int&, const Square<int>&> fig) {
+            return fig.second.Area() < area;
+        });
+    }
+
+    void ForEach(const std::function<void(int, const figure_type&)>& function) override {
+        for (auto pair : snapshots_.Snapshot()) {
+            function(pair.first, pair.second);
+        }
+    }
+
+    tree_type figures_;
+    snapshot_tree_type snapshots_;
+    std::shared_mutex mutex_;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "CompactingPool.h"
+
+// Дерево поиска в CompactingPool: узлы связаны дескрипторами пула, а не
+// указателями, поэтому Compact() переносит их без исправления связей.
+// Адрес узла получается через Resolve() перед каждым обращением и нигде не
+// хранится; указатель из Find() верен до следующего выделения в пуле.
+// Равные ключи, как и в Tree, уходят вправо.
+template <typename Key, typename Value, size_t MEM_SIZE>
+class HandleTree {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "CompactingPool moves nodes with memmove");
+
+public:
+    using pool_type = Allocators::CompactingPool<MEM_SIZE>;
+    using handle_type = typename pool_type::handle_type;
+
+    explicit HandleTree(pool_type& pool)
+    : pool_(pool) {}
+
+    ~HandleTree() {
+        Clear();
+    }
+
+    HandleTree(const HandleTree&) = delete;
+    HandleTree(HandleTree&&) = delete;
+
+    Value* Find(const Key& elem) {
+        handle_type cur = root_;
+        while (cur != kNull) {
+            Node& cur_node = node(cur);
+            if (elem == cur_node.key) {
+                return &cur_node.value;
+            }
+            cur = elem > cur_node.key ? cur_node.right : cur_node.left;
+        }
+        return nullptr;
+    }
+
+    void Insert(const Key& elem_key, const Value& elem_value) {
+        // Allocate может уплотнить пул, поэтому путь ищется уже после него
+        handle_type new_elem = pool_.Allocate(sizeof(Node));
+        new (pool_.Resolve(new_elem)) Node{elem_key, elem_value, kNull, kNull};
+        handle_type* link = &root_;
+        while (*link != kNull) {
+            Node& cur_node = node(*link);
+            link = elem_key >= cur_node.key ? &cur_node.right : &cur_node.left;
+        }
+        *link = new_elem;
+        ++size_;
+    }
+
+    bool Erase(const Key& elem) {
+        handle_type* link = &root_;
+        while (*link != kNull && !(elem == node(*link).key)) {
+            Node& cur_node = node(*link);
+            link = elem > cur_node.key ? &cur_node.right : &cur_node.left;
+        }
+        if (*link == kNull) {
+            return false;
+        }
+        handle_type target = *link;
+        Node& target_node = node(target);
+        if (target_node.left == kNull) {
+            *link = target_node.right;
+        } else if (target_node.right == kNull) {
+            *link = target_node.left;
+        } else {
+            // на место удаляемого встаёт минимальный узел правого поддерева
+            handle_type* min_link = &target_node.right;
+            while (node(*min_link).left != kNull) {
+                min_link = &node(*min_link).left;
+            }
+            handle_type replacer = *min_link;
+            *min_link = node(replacer).right;
+            node(replacer).left = target_node.left;
+            node(replacer).right = target_node.right;
+            *link = replacer;
+        }
+        pool_.Free(target);
+        --size_;
+        return true;
+    }
+
+    // Обход по возрастанию ключей. Функция не должна менять дерево и
+    // выделять память в пуле.
+    template <typename Function>
+    void ForEach(Function function) {
+        std::vector<handle_type> stack;
+        handle_type cur = root_;
+        while (cur != kNull || !stack.empty()) {
+            while (cur != kNull) {
+                stack.push_back(cur);
+                cur = node(cur).left;
+            }
+            cur = stack.back();
+            stack.pop_back();
+            Node& cur_node = node(cur);
+            function(static_cast<const Key&>(cur_node.key), cur_node.value);
+            cur = cur_node.right;
+        }
+    }
+
+    void Clear() {
+        std::vector<handle_type> stack;
+        if (root_ != kNull) {
+            stack.push_back(root_);
+        }
+        while (!stack.empty()) {
+            handle_type cur = stack.back();
+            stack.pop_back();
+            if (node(cur).left != kNull) {
+                stack.push_back(node(cur).left);
+            }
+            if (node(cur).right != kNull) {
+                stack.push_back(node(cur).right);
+            }
+            pool_.Free(cur);
+        }
+        root_ = kNull;
+        size_ = 0;
+    }
+
+    bool Empty() const {
+        return root_ == kNull;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    static constexpr handle_type kNull = pool_type::kNullHandle;
+
+    struct Node {
+        Key key;
+        Value value;
+        handle_type left;
+        handle_type right;
+    };
+
+    Node& node(handle_type handle) {
+        return *pool_.template Get<Node>(handle);
+    }
+
+    pool_type& pool_;
+    handle_type root_ = kNull;
+    size_t size_ = 0;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "AllocatorRef.h"
+
+// Есть ли у ключа std::hash: без него контейнеры работают без индекса.
+template <typename Key, typename = void>
+struct IsHashable : std::false_type {};
+
+template <typename Key>
+struct IsHashable<Key, std::void_t<decltype(std::hash<Key>{}(std::declval<const Key&>()))>> : std::true_type {};
+
+// Хэш-таблица с открытой адресацией (robin hood): при вставке элемент,
+// ушедший от своей позиции дальше, вытесняет более «богатый». Удаление
+// сдвигает хвост цепочки назад, поэтому надгробия не нужны. Память под
+// ячейки берётся из байтового аллокатора контейнера.
+template <typename Key, typename Value, typename ByteAllocator, typename Hash = std::hash<Key>>
+class HashIndex {
+public:
+    explicit HashIndex(std::shared_ptr<ByteAllocator> allocator)
+    : allocator_(std::move(allocator)) {}
+
+    ~HashIndex() {
+        Release();
+    }
+
+    HashIndex(const HashIndex&) = delete;
+    HashIndex(HashIndex&&) = delete;
+
+    Value* Find(const Key& key) {
+        if (size_ == 0) {
+            return nullptr;
+        }
+        size_t index = Bucket(key);
+        for (uint32_t distance = 1; ; ++distance) {
+            Slot& slot = slots_[index];
+            if (slot.distance < distance) {
+                return nullptr;
+            }
+            if (slot.entry().first == key) {
+                return &slot.entry().second;
+            }
+            index = (index + 1) & (capacity_ - 1);
+        }
+    }
+
+    // Вставляет пару или заменяет значение существующего ключа.
+    void Insert(const Key& key, const Value& value) {
+        if (Value* found = Find(key)) {
+            *found = value;
+            return;
+        }
+        Reserve(size_ + 1);
+        Place(std::pair<Key, Value>(key, value));
+        ++size_;
+    }
+
+    bool Erase(const Key& key) {
+        if (size_ == 0) {
+            return false;
+        }
+        size_t index = Bucket(key);
+        for (uint32_t distance = 1; ; ++distance) {
+            Slot& slot = slots_[index];
+            if (slot.distance < distance) {
+                return false;
+            }
+            if (slot.entry().first == key) {
+                break;
+            }
+            index = (index + 1) & (capacity_ - 1);
+        }
+        slots_[index].Destroy();
+        size_t next = (index + 1) & (capacity_ - 1);
+        while (slots_[next].distance > 1) {
+            slots_[index].Construct(std::move(slots_[next].entry()), slots_[next].distance - 1);
+            slots_[next].Destroy();
+            index = next;
+            next = (next + 1) & (capacity_ - 1);
+        }
+        --size_;
+        return true;
+    }
+
+    // Готовит место под count элементов, чтобы следующие Insert не
+    // выделяли память и не бросали исключений.
+    void Reserve(size_t count) {
+        size_t capacity = capacity_ == 0 ? kMinCapacity : capacity_;
+        while (count * 8 > capacity * 7) {
+            capacity *= 2;
+        }
+        if (capacity != capacity_) {
+            Rehash(capacity);
+        }
+    }
+
+    void Clear() {
+        Release();
+    }
+
+    // Забывает ячейки без деструкторов и deallocate, когда их память
+    // возвращается целиком сбросом арены.
+    void Abandon() {
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    static constexpr size_t kMinCapacity = 8;
+
+    struct Slot {
+        // 0 — ячейка пуста, иначе расстояние от идеальной позиции плюс один.
+        uint32_t distance;
+        alignas(std::pair<Key, Value>) unsigned char storage[sizeof(std::pair<Key, Value>)];
+
+        std::pair<Key, Value>& entry() {
+            return *std::launder(reinterpret_cast<std::pair<Key, Value>*>(storage));
+        }
+
+        void Construct(std::pair<Key, Value>&& value, uint32_t new_distance) {
+            new (storage) std::pair<Key, Value>(std::move(value));
+            distance = new_distance;
+        }
+
+        void Destroy() {
+            entry().~pair();
+            distance = 0;
+        }
+    };
+
+    using slot_allocator_type = Allocators::AllocatorRef<Slot, ByteAllocator>;
+
+    // Фибоначчиево хэширование: старшие биты произведения, чтобы
+    // std::hash-тождество для int и выровненных указателей не давало
+    // длинных цепочек.
+    size_t Bucket(const Key& key) const {
+        return static_cast<size_t>((static_cast<uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ULL) >> shift_);
+    }
+
+    void Place(std::pair<Key, Value>&& value) {
+        size_t index = Bucket(value.first);
+        uint32_t distance = 1;
+        while (true) {
+            Slot& slot = slots_[index];
+            if (slot.distance == 0) {
+                slot.Construct(std::move(value), distance);
+                return;
+            }
+            if (slot.distance < distance) {
+                std::swap(slot.entry(), value);
+                std::swap(slot.distance, distance);
+            }
+            index = (index + 1) & (capacity_ - 1);
+            ++distance;
+        }
+    }
+
+    void Rehash(size_t new_capacity) {
+        Slot* old_slots = slots_;
+        size_t old_capacity = capacity_;
+        slots_ = slot_allocator_type(allocator_).allocate(new_capacity);
+        capacity_ = new_capacity;
+        shift_ = 64;
+        for (size_t i = capacity_; i > 1; i /= 2) {
+            --shift_;
+        }
+        for (size_t i = 0; i < capacity_; ++i) {
+            new (&slots_[i]) Slot;
+            slots_[i].distance = 0;
+        }
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_slots[i].distance != 0) {
+                Place(std::move(old_slots[i].entry()));
+                old_slots[i].Destroy();
+            }
+        }
+        if (old_slots != nullptr) {
+            slot_allocator_type(allocator_).deallocate(old_slots, old_capacity);
+        }
+    }
+
+    void Release() {
+        if (slots_ == nullptr) {
+            return;
+        }
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (slots_[i].distance != 0) {
+                slots_[i].Destroy();
+            }
+        }
+        slot_allocator_type(allocator_).deallocate(slots_, capacity_);
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+    }
+
+    std::shared_ptr<ByteAllocator> allocator_;
+    Slot* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    unsigned shift_ = 64;
+};
@@ -2,6 +2,10 @@
 
 #include <memory>
 #include <exception>
+#include <new>
+#include <type_traits>
+
+#include "AllocatorRef.h"
 
 namespace Containers {
 
@@ -68,32 +72,44 @@ namespace Containers {
     template <typename T, typename Allocator = std::allocator<T>>
     class List {
     public:
-        using allocator_type = typename Allocator::template rebind<ListNode<T>>::other;
-
-        struct deleter {
-            deleter(allocator_type* allocator) : allocator_(allocator) {}
-
-            void operator() (ListNode<T>* ptr) {
-                std::allocator_traits<allocator_type >::destroy(*allocator_, ptr);
-                allocator_->deallocate(ptr,1);
-            }
-
-        private:
-            allocator_type* allocator_;
-        };
+        using allocator_type = typename Allocator::template rebind<char>::other;
+        using node_allocator_type = Allocators::AllocatorRef<ListNode<T>, allocator_type>;
 
         List() {
-            ListNode<T>* ptr = allocator_.allocate(1);
-            std::allocator_traits<allocator_type >::construct(allocator_, ptr);
-            std::shared_ptr<ListNode<T>> new_elem(ptr, deleter(&allocator_));
+            std::shared_ptr<ListNode<T>> new_elem = MakeNode();
             tail = new_elem;
             head = tail;
             tail->next = nullptr;
         }
 
+        ~List() {
+            Clear();
+        }
+
         List(const List&) = delete;
         List(List&&) = delete;
 
+        // Узлы снимаются с головы по одному, чтобы длинный список не
+        // освобождался рекурсивной цепочкой деструкторов.
+        void Clear() {
+            while (head != tail) {
+                head = head->next;
+            }
+            tail->prev.reset();
+        }
+
+        // Выбрасывает все узлы разом сбросом арены (Allocators::MonotonicArena),
+        // без деструкторов. Итераторы к этому моменту должны быть уничтожены.
+        void Release() {
+            static_assert(std::is_trivially_destructible_v<T>,
+                          "Release skips destructors, use Clear for such elements");
+            Abandon(head);
+            Abandon(tail);
+            allocator_->Reset();
+            tail = MakeNode();
+            head = tail;
+        }
+
         bool Empty() const {
             return head == tail;
         }
@@ -118,9 +134,7 @@ namespace Containers {
         }
 
         void Insert(ListIterator<T> iter, T elem) {
-            ListNode<T>* ptr = allocator_.allocate(1);
-            std::allocator_traits<allocator_type>::construct(allocator_, ptr);
-            std::shared_ptr<ListNode<T>> new_elem(ptr, deleter(&allocator_));
+            std::shared_ptr<ListNode<T>> new_elem = MakeNode();
             new_elem->data = std::move(elem);
             if (iter == begin()) {
                 new_elem->next = head;
@@ -161,7 +175,16 @@ namespace Containers {
         }
 
     private:
-        allocator_type allocator_;
+        static void Abandon(std::shared_ptr<ListNode<T>>& ptr) {
+            alignas(std::shared_ptr<ListNode<T>>) unsigned char storage[sizeof(std::shared_ptr<ListNode<T>>)];
+            new (storage) std::shared_ptr<ListNode<T>>(std::move(ptr));
+        }
+
+        std::shared_ptr<ListNode<T>> MakeNode() {
+            return std::allocate_shared<ListNode<T>>(node_allocator_type(allocator_));
+        }
+
+        std::shared_ptr<allocator_type> allocator_ = std::make_shared<allocator_type>();
         std::shared_ptr<ListNode<T>> head;
         std::shared_ptr<ListNode<T>> tail;
     };
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Allocators {
+
+// Указатель, хранящий смещение относительно собственного адреса. Остаётся
+// верным, если файл отображён по другому адресу, поэтому годится для связей
+// между узлами внутри MappedArena.
+template <typename T>
+class OffsetPtr {
+public:
+    OffsetPtr() = default;
+
+    OffsetPtr(T* ptr) {
+        Set(ptr);
+    }
+
+    OffsetPtr(const OffsetPtr& other) {
+        Set(other.get());
+    }
+
+    OffsetPtr& operator = (const OffsetPtr& other) {
+        Set(other.get());
+        return *this;
+    }
+
+    OffsetPtr& operator = (T* ptr) {
+        Set(ptr);
+        return *this;
+    }
+
+    T* get() const {
+        if (offset_ == kNull) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + offset_);
+    }
+
+    T& operator * () const {
+        return *get();
+    }
+
+    T* operator -> () const {
+        return get();
+    }
+
+    explicit operator bool () const {
+        return offset_ != kNull;
+    }
+
+    bool operator == (const OffsetPtr& other) const {
+        return get() == other.get();
+    }
+
+    bool operator != (const OffsetPtr& other) const {
+        return !(*this == other);
+    }
+
+private:
+    // Смещение 1 невозможно для выровненного объекта и обозначает nullptr.
+    static constexpr std::ptrdiff_t kNull = 1;
+
+    void Set(T* ptr) {
+        offset_ = ptr == nullptr
+                ? kNull
+                : reinterpret_cast<const char*>(ptr) - reinterpret_cast<const char*>(this);
+    }
+
+    std::ptrdiff_t offset_ = kNull;
+};
+
+// Пул в отображённом в память файле. Вся служебная информация хранится
+// внутри файла в виде смещений от начала отображения, так что после
+// повторного открытия пул продолжает работу без десериализации.
+//
+// Согласованность после сбоя: заголовки блоков образуют цепочку по всему
+// файлу и являются источником истины, а список свободных блоков лишь кэш.
+// Перед первым изменением после Checkpoint() в заголовок синхронно пишется
+// флаг dirty. Если при открытии флаг установлен, список свободных блоков
+// строится заново обходом цепочки; испорченный хвост цепочки объявляется
+// свободным. Данные, записанные после последнего Checkpoint(), могут
+// потеряться, метаданные пула — нет.
+class MappedArena {
+public:
+    MappedArena(const std::string& path, size_t size) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            Fail("fstat " + path);
+        }
+        bool existing = static_cast<size_t>(st.st_size) >= sizeof(Header);
+        if (existing) {
+            size_ = st.st_size;
+        } else {
+            size_ = AlignUp(size < sizeof(Header) + kMinBlock ? sizeof(Header) + kMinBlock : size);
+            if (ftruncate(fd_, size_) != 0) {
+                Fail("ftruncate " + path);
+            }
+        }
+        void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (base == MAP_FAILED) {
+            Fail("mmap " + path);
+        }
+        base_ = static_cast<char*>(base);
+
+        if (!existing) {
+            Format();
+        } else if (header()->magic != kMagic || header()->version != kVersion || header()->size != size_) {
+            munmap(base_, size_);
+            close(fd_);
+            throw std::runtime_error("File is not a compatible arena: " + path);
+        } else if (!header()->clean) {
+            Recover();
+            recovered_ = true;
+        }
+    }
+
+    ~MappedArena() {
+        try {
+            Checkpoint();
+        } catch (...) {
+        }
+        munmap(base_, size_);
+        close(fd_);
+    }
+
+    MappedArena(const MappedArena&) = delete;
+    MappedArena(MappedArena&&) = delete;
+
+    char* allocate(size_t alloc_size) {
+        if (alloc_size == 0) {
+            throw std::logic_error("Allocation of 0 bytes");
+        }
+        size_t need = AlignUp(alloc_size + sizeof(BlockHeader));
+        if (need < kMinBlock) {
+            need = kMinBlock;
+        }
+        MarkDirty();
+        uint64_t prev = 0;
+        uint64_t cur = header()->free_head;
+        while (cur != 0 && block(cur)->size < need) {
+            prev = cur;
+            cur = NextFree(cur);
+        }
+        if (cur == 0) {
+            throw std::bad_alloc();
+        }
+        uint64_t next = NextFree(cur);
+        uint64_t block_size = block(cur)->size;
+        if (block_size - need >= kMinBlock) {
+            // Сначала пишется заголовок остатка, потом он подменяет блок в
+            // списке, и только затем блок уменьшается и помечается занятым.
+            uint64_t rest = cur + need;
+            WriteBlock(rest, block_size - need, kFree);
+            SetNextFree(rest, next);
+            next = rest;
+            LinkAfter(prev, next);
+            WriteBlock(cur, need, kBusy);
+        } else {
+            LinkAfter(prev, next);
+            WriteBlock(cur, block_size, kBusy);
+        }
+        return base_ + cur + sizeof(BlockHeader);
+    }
+
+    void deallocate(char* ptr, size_t) {
+        uint64_t offset = ptr - base_ - sizeof(BlockHeader);
+        if (ptr < base_ + sizeof(Header) || ptr >= base_ + size_ || !Valid(offset) || block(offset)->state != kBusy) {
+            throw std::logic_error("Wrong ptr to deallocate");
+        }
+        MarkDirty();
+        WriteBlock(offset, block(offset)->size, kFree);
+
+        uint64_t prev = 0;
+        uint64_t cur = header()->free_head;
+        while (cur != 0 && cur < offset) {
+            prev = cur;
+            cur = NextFree(cur);
+        }
+        SetNextFree(offset, cur);
+        LinkAfter(prev, offset);
+
+        if (cur != 0 && offset + block(offset)->size == cur) {
+            SetNextFree(offset, NextFree(cur));
+            WriteBlock(offset, block(offset)->size + block(cur)->size, kFree);
+        }
+        if (prev != 0 && prev + block(prev)->size == offset) {
+            SetNextFree(prev, NextFree(offset));
+            WriteBlock(prev, block(prev)->size + block(offset)->size, kFree);
+        }
+    }
+
+    // Корневой объект, с которого начинается работа с данными после
+    // повторного открытия файла.
+    void* Root() const {
+        return header()->root == 0 ? nullptr : base_ + header()->root;
+    }
+
+    void SetRoot(void* ptr) {
+        MarkDirty();
+        header()->root = ptr == nullptr ? 0 : static_cast<char*>(ptr) - base_;
+    }
+
+    // Асинхронно сбрасывает изменённые страницы на диск.
+    void Sync() {
+        if (msync(base_, size_, MS_ASYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    // Синхронно сбрасывает данные и помечает пул согласованным.
+    void Checkpoint() {
+        if (header()->clean) {
+            return;
+        }
+        if (msync(base_, size_, MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+        header()->clean = 1;
+        ++header()->generation;
+        SyncHeader();
+    }
+
+    // Синхронно снимает флаг согласованности. allocate/deallocate/SetRoot
+    // вызывают его сами; структура, которая меняет свои данные в арене без
+    // выделения памяти, вызывает его перед первой записью.
+    void MarkDirty() {
+        if (header()->clean) {
+            header()->clean = 0;
+            SyncHeader();
+        }
+    }
+
+    bool Recovered() const {
+        return recovered_;
+    }
+
+    uint64_t Generation() const {
+        return header()->generation;
+    }
+
+    size_t FreeBytes() const {
+        size_t result = 0;
+        for (uint64_t cur = header()->free_head; cur != 0; cur = NextFree(cur)) {
+            result += block(cur)->size - sizeof(BlockHeader);
+        }
+        return result;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x414e455241455254ULL; // "TREEARNA"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kFree = 0x45455246;             // "FREE"
+    static constexpr uint32_t kBusy = 0x59535542;             // "BUSY"
+    static constexpr size_t kAlign = 16;
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t clean;
+        uint64_t size;
+        uint64_t generation;
+        uint64_t root;
+        uint64_t free_head;
+        uint64_t reserved[2];
+    };
+
+    struct BlockHeader {
+        uint64_t size;
+        uint32_t state;
+        uint32_t check;
+    };
+
+    static constexpr size_t kMinBlock = sizeof(BlockHeader) + kAlign;
+
+    static size_t AlignUp(size_t value) {
+        return (value + kAlign - 1) / kAlign * kAlign;
+    }
+
+    static uint32_t Check(uint64_t size, uint32_t state) {
+        return static_cast<uint32_t>(size ^ (size >> 32)) ^ state ^ 0x9e3779b9u;
+    }
+
+    Header* header() const {
+        return reinterpret_cast<Header*>(base_);
+    }
+
+    BlockHeader* block(uint64_t offset) const {
+        return reinterpret_cast<BlockHeader*>(base_ + offset);
+    }
+
+    uint64_t NextFree(uint64_t offset) const {
+        uint64_t next;
+        std::memcpy(&next, base_ + offset + sizeof(BlockHeader), sizeof(next));
+        return next;
+    }
+
+    void SetNextFree(uint64_t offset, uint64_t next) {
+        std::memcpy(base_ + offset + sizeof(BlockHeader), &next, sizeof(next));
+    }
+
+    void LinkAfter(uint64_t prev, uint64_t next) {
+        if (prev == 0) {
+            header()->free_head = next;
+        } else {
+            SetNextFree(prev, next);
+        }
+    }
+
+    void WriteBlock(uint64_t offset, uint64_t size, uint32_t state) {
+        BlockHeader* info = block(offset);
+        info->size = size;
+        info->state = state;
+        info->check = Check(size, state);
+    }
+
+    bool Valid(uint64_t offset) const {
+        if (offset < FirstBlock() || offset + sizeof(BlockHeader) > size_ || offset % kAlign != 0) {
+            return false;
+        }
+        const BlockHeader* info = block(offset);
+        return info->size >= kMinBlock && info->size % kAlign == 0
+               && info->size <= size_ - offset
+               && (info->state == kFree || info->state == kBusy)
+               && info->check == Check(info->size, info->state);
+    }
+
+    static uint64_t FirstBlock() {
+        return AlignUp(sizeof(Header));
+    }
+
+    void Format() {
+        std::memset(base_, 0, FirstBlock());
+        header()->magic = kMagic;
+        header()->version = kVersion;
+        header()->size = size_;
+        header()->clean = 0;
+        WriteBlock(FirstBlock(), size_ - FirstBlock(), kFree);
+        SetNextFree(FirstBlock(), 0);
+        header()->free_head = FirstBlock();
+        Checkpoint();
+    }
+
+    // Восстанавливает список свободных блоков по цепочке заголовков.
+    void Recover() {
+        uint64_t last_free = 0;
+        header()->free_head = 0;
+        uint64_t offset = FirstBlock();
+        while (offset < size_) {
+            if (!Valid(offset)) {
+                WriteBlock(offset, size_ - offset, kFree);
+            }
+            if (block(offset)->state == kFree) {
+                if (last_free != 0 && last_free + block(last_free)->size == offset) {
+                    WriteBlock(last_free, block(last_free)->size + block(offset)->size, kFree);
+                } else {
+                    SetNextFree(offset, 0);
+                    LinkAfter(last_free, offset);
+                    last_free = offset;
+                }
+            }
+            offset += block(offset)->size;
+        }
+        if (header()->root != 0 && !(header()->root < size_ && header()->root >= FirstBlock())) {
+            header()->root = 0;
+        }
+        Checkpoint();
+    }
+
+    void SyncHeader() {
+        if (msync(base_, FirstBlock(), MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    [[noreturn]] void Fail(const std::string& what) {
+        int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    size_t size_ = 0;
+    bool recovered_ = false;
+};
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "FigureCommands.h"
+#include "MappedArena.h"
+#include "MappedTree.h"
+#include "Square.h"
+#include "Stats.h"
+
+// Хранилище квадратов в отображённом файле: набор переживает перезапуск
+// программы. Команды разбирает тот же ExecuteFigureCommand, что и для
+// FigureStore; блокировок нет, хранилище рассчитано на один поток.
+class MappedFigureStore : public FigureBackend {
+public:
+    static constexpr size_t kArenaSize = 1 << 20;
+
+    explicit MappedFigureStore(const std::string& path)
+    : arena_(path, kArenaSize), figures_(arena_) {}
+
+    MappedFigureStore(const MappedFigureStore&) = delete;
+    MappedFigureStore(MappedFigureStore&&) = delete;
+
+    bool Recovered() const {
+        return arena_.Recovered();
+    }
+
+    bool Contains(int key) override {
+        return figures_.Find(key) != nullptr;
+    }
+
+    void Add(int key, const figure_type& figure) override {
+        figures_.Insert(key, figure);
+    }
+
+    bool Erase(int key) override {
+        return figures_.Erase(key);
+    }
+
+    size_t Size() override {
+        return figures_.Size();
+    }
+
+    size_t CountSmaller(double area) override {
+        size_t count = 0;
+        figures_.ForEach([&count, area] (int, const figure_type& figure) {
+            count += figure.Area() < area ? 1 : 0;
+        });
+        return count;
+    }
+
+    void ForEach(const std::function<void(int, const figure_type&)>& function) override {
+        figures_.ForEach(function);
+    }
+
+    void PrintStats(std::ostream& os) override {
+        os << "tree.size " << figures_.Size() << "\n";
+        if (STATS_ENABLED) {
+            Stats::Registry::Instance().Print(os);
+        } else {
+            os << "instrumentation disabled, build with FIGURE_STATS\n";
+        }
+    }
+
+private:
+    Allocators::MappedArena arena_;
+    MappedTree<int, figure_type> figures_;
+};
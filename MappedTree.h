@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "MappedArena.h"
+
+// Дерево поиска целиком внутри MappedArena: связи между узлами — OffsetPtr,
+// ключи и значения копируются побайтно, поэтому после повторного открытия
+// файла дерево доступно сразу, через Root() арены. Равные ключи, как и в
+// Tree, уходят вправо.
+//
+// Арена помечается изменённой до первой записи. Каждое изменение дерева
+// публикуется одной записью смещения: новый узел заполняется целиком и
+// только потом подвешивается, удаляемый сначала отвязывается и только потом
+// освобождается. После сбоя дерево остаётся обходимым и ни один ключ не
+// теряется; могут пропасть изменения после последнего Checkpoint() и
+// блоки недописанных узлов, а при сбое посреди удаления узла с двумя
+// детьми ключ-преемник может остаться в дереве дважды.
+template <typename Key, typename Value>
+struct MappedTreeNode {
+    MappedTreeNode(const Key& new_key, const Value& new_value)
+    : key(new_key), value(new_value) {}
+
+    Key key;
+    Value value;
+    Allocators::OffsetPtr<MappedTreeNode> left;
+    Allocators::OffsetPtr<MappedTreeNode> right;
+};
+
+template <typename Key, typename Value>
+class MappedTree {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "MappedTree stores keys and values as raw bytes in a file");
+
+    using node_type = MappedTreeNode<Key, Value>;
+
+public:
+    // Открывает дерево, записанное в арене, или создаёт пустое и делает его
+    // корнем арены.
+    explicit MappedTree(Allocators::MappedArena& arena)
+    : arena_(arena) {
+        anchor_ = static_cast<Anchor*>(arena_.Root());
+        if (anchor_ == nullptr) {
+            anchor_ = new (arena_.allocate(sizeof(Anchor))) Anchor;
+            arena_.SetRoot(anchor_);
+            arena_.Checkpoint();
+        } else if (anchor_->magic != kMagic || anchor_->key_size != sizeof(Key)
+                   || anchor_->value_size != sizeof(Value)) {
+            throw std::runtime_error("Arena root is not a tree of this type");
+        } else if (arena_.Recovered()) {
+            // счётчик мог не успеть обновиться вместе со связями
+            size_t count = 0;
+            ForEach([&count] (const Key&, const Value&) {
+                ++count;
+            });
+            anchor_->size = count;
+        }
+    }
+
+    MappedTree(const MappedTree&) = delete;
+    MappedTree(MappedTree&&) = delete;
+
+    Value* Find(const Key& elem) {
+        node_type* cur_ptr = anchor_->root.get();
+        while (cur_ptr != nullptr) {
+            if (elem == cur_ptr->key) {
+                return &cur_ptr->value;
+            } else if (elem > cur_ptr->key) {
+                cur_ptr = cur_ptr->right.get();
+            } else {
+                cur_ptr = cur_ptr->left.get();
+            }
+        }
+        return nullptr;
+    }
+
+    void Insert(const Key& elem_key, const Value& elem_value) {
+        node_type* new_elem = new (arena_.allocate(sizeof(node_type))) node_type(elem_key, elem_value);
+        Allocators::OffsetPtr<node_type>* link = &anchor_->root;
+        while (*link) {
+            link = elem_key >= (*link)->key ? &(*link)->right : &(*link)->left;
+        }
+        *link = new_elem;
+        ++anchor_->size;
+    }
+
+    bool Erase(const Key& elem) {
+        Allocators::OffsetPtr<node_type>* link = &anchor_->root;
+        while (*link && !(elem == (*link)->key)) {
+            link = elem > (*link)->key ? &(*link)->right : &(*link)->left;
+        }
+        if (!*link) {
+            return false;
+        }
+        arena_.MarkDirty();
+        node_type* target = link->get();
+        if (!target->left) {
+            *link = target->right.get();
+        } else if (!target->right) {
+            *link = target->left.get();
+        } else {
+            // Место удаляемого занимает копия минимального узла правого
+            // поддерева: одна запись заменяет удаляемый узел, вторая убирает
+            // оригинал преемника. Между ними преемник виден дважды.
+            Allocators::OffsetPtr<node_type>* min_link = &target->right;
+            while ((*min_link)->left) {
+                min_link = &(*min_link)->left;
+            }
+            node_type* replacer = new (arena_.allocate(sizeof(node_type)))
+                    node_type((*min_link)->key, (*min_link)->value);
+            replacer->left = target->left.get();
+            replacer->right = target->right.get();
+            *link = replacer;
+
+            min_link = &replacer->right;
+            while ((*min_link)->left) {
+                min_link = &(*min_link)->left;
+            }
+            node_type* original = min_link->get();
+            *min_link = original->right.get();
+            arena_.deallocate(reinterpret_cast<char*>(original), sizeof(node_type));
+        }
+        --anchor_->size;
+        arena_.deallocate(reinterpret_cast<char*>(target), sizeof(node_type));
+        return true;
+    }
+
+    // Обход по возрастанию ключей.
+    template <typename Function>
+    void ForEach(Function function) {
+        std::vector<node_type*> stack;
+        node_type* cur_ptr = anchor_->root.get();
+        while (cur_ptr != nullptr || !stack.empty()) {
+            while (cur_ptr != nullptr) {
+                stack.push_back(cur_ptr);
+                cur_ptr = cur_ptr->left.get();
+            }
+            cur_ptr = stack.back();
+            stack.pop_back();
+            function(static_cast<const Key&>(cur_ptr->key), cur_ptr->value);
+            cur_ptr = cur_ptr->right.get();
+        }
+    }
+
+    bool Empty() const {
+        return !anchor_->root;
+    }
+
+    size_t Size() const {
+        return anchor_->size;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x45455254504d4146ULL; // "FAMPTREE"
+
+    struct Anchor {
+        uint64_t magic = kMagic;
+        uint32_t key_size = sizeof(Key);
+        uint32_t value_size = sizeof(Value);
+        uint64_t size = 0;
+        Allocators::OffsetPtr<node_type> root;
+    };
+
+    Allocators::MappedArena& arena_;
+    Anchor* anchor_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace Allocators {
+
+// Арена со сдвигом указателя: allocate только двигает границу, deallocate
+// ничего не делает, а вся память возвращается разом через Reset().
+// Подходит для пакетной работы: построить набор, выполнить запросы и
+// выбросить его целиком через Tree::Release() или List::Release().
+// Узлы не продлевают арене жизнь (см. IsMonotonic), поэтому итераторы не
+// должны переживать ни Release(), ни сам контейнер.
+template <typename T, size_t MEM_SIZE>
+class MonotonicArena {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using is_always_equal = std::false_type;
+    using is_monotonic = std::true_type;
+
+    template<class V>
+    struct rebind {
+        using other = MonotonicArena<V, MEM_SIZE>;
+    };
+
+    MonotonicArena() {
+        pool_ = (char*) std::aligned_alloc(kAlign, Capacity());
+        if (pool_ == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~MonotonicArena() {
+        std::free(pool_);
+    }
+
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena(MonotonicArena &&) = delete;
+
+    T* allocate(size_t alloc_size) {
+        if (alloc_size == 0) {
+            throw std::logic_error("Allocation of 0 bytes");
+        }
+        alloc_size = (alloc_size * sizeof(T) + kAlign - 1) / kAlign * kAlign;
+        if (alloc_size > Capacity() - used_) {
+            throw std::bad_alloc();
+        }
+        char* block_ptr = pool_ + used_;
+        used_ += alloc_size;
+        return (T*)block_ptr;
+    }
+
+    void deallocate(T*, size_t) {
+    }
+
+    // Возвращает всю память арены. Все выданные блоки становятся
+    // недействительными, деструкторы объектов в них не вызываются.
+    void Reset() {
+        used_ = 0;
+    }
+
+    size_t Used() const {
+        return used_;
+    }
+
+    static constexpr size_t Capacity() {
+        return (MEM_SIZE + kAlign - 1) / kAlign * kAlign;
+    }
+
+private:
+    static constexpr size_t kAlign = alignof(std::max_align_t);
+
+    char* pool_;
+    size_t used_ = 0;
+};
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "AllocatorRef.h"
+#include "TreeReduce.h"
+
+// Дерево поиска с копированием пути. Узлы после создания не меняются:
+// изменение копирует только путь от корня до изменённого узла, остальные
+// поддеревья разделяются между версиями. Snapshot() за O(1) возвращает
+// неизменяемую версию, которую можно обходить, пока дерево меняется.
+// Дерево не балансируется, поэтому путь, а с ним и копирование, для ключей
+// по возрастанию растёт линейно.
+//
+// Освобождает узлы только поток писателя: он держит ссылку на каждую
+// вытесненную версию и отпускает её при очередном изменении, когда других
+// ссылок не осталось. Снимок свою ссылку никогда не отпускает последним,
+// поэтому аллокатор дерева не нужно защищать от читателей, а чтение не
+// берёт никаких блокировок.
+
+// Корень и размер публикуются вместе, чтобы снимок был согласованным.
+template <typename Node>
+struct TreeVersion {
+    std::shared_ptr<const Node> root;
+    size_t size;
+};
+
+template <typename Key, typename Value>
+struct PersistentTreeNode {
+    using node_ptr = std::shared_ptr<const PersistentTreeNode>;
+
+    PersistentTreeNode(const Key& new_key, const Value& new_value, node_ptr new_left, node_ptr new_right)
+    : key(new_key), value(new_value), left(std::move(new_left)), right(std::move(new_right)) {}
+
+    PersistentTreeNode(const PersistentTreeNode&) = delete;
+
+    // Цепочка от ключей по возрастанию при рекурсивном освобождении через
+    // shared_ptr переполняет стек, поэтому поддеревья, которыми владеет
+    // только этот узел, разбираются по явному стеку. Поддеревья, общие с
+    // другими версиями, только теряют одну ссылку.
+    ~PersistentTreeNode() {
+        std::vector<node_ptr> stack;
+        Detach(left, stack);
+        Detach(right, stack);
+        while (!stack.empty()) {
+            node_ptr node = std::move(stack.back());
+            stack.pop_back();
+            // последняя ссылка на узел здесь, его больше никто не видит
+            PersistentTreeNode& owned = const_cast<PersistentTreeNode&>(*node);
+            Detach(owned.left, stack);
+            Detach(owned.right, stack);
+        }
+    }
+
+    const Key key;
+    const Value value;
+    // Не меняются после создания; не const только ради деструктора.
+    node_ptr left;
+    node_ptr right;
+
+private:
+    static void Detach(node_ptr& child, std::vector<node_ptr>& stack) {
+        if (child != nullptr && child.use_count() == 1) {
+            stack.push_back(std::move(child));
+        }
+    }
+};
+
+template <typename Key, typename Value, typename Allocator = std::allocator<PersistentTreeNode<Key, Value>>>
+class TreeSnapshot {
+public:
+    using node_type = PersistentTreeNode<Key, Value>;
+    using node_ptr = typename node_type::node_ptr;
+    using allocator_type = typename Allocator::template rebind<char>::other;
+    using version_type = TreeVersion<node_type>;
+
+    struct Iterator {
+        using value_type = std::pair<const Key&, const Value&>;
+        using reference = value_type;
+        using pointer = void;
+        using difference_type = ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator() = default;
+
+        explicit Iterator(const node_type* root) {
+            PushLeft(root);
+        }
+
+        std::pair<const Key&, const Value&> operator * () const {
+            return std::pair<const Key&, const Value&>(stack_.back()->key, stack_.back()->value);
+        }
+
+        Iterator& operator ++ () {
+            const node_type* node = stack_.back();
+            stack_.pop_back();
+            PushLeft(node->right.get());
+            return *this;
+        }
+
+        Iterator operator ++ (int) {
+            Iterator copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        bool operator == (const Iterator& other) const {
+            if (stack_.empty() || other.stack_.empty()) {
+                return stack_.empty() == other.stack_.empty();
+            }
+            return stack_.back() == other.stack_.back();
+        }
+
+        bool operator != (const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        void PushLeft(const node_type* node) {
+            while (node != nullptr) {
+                stack_.push_back(node);
+                node = node->left.get();
+            }
+        }
+
+        std::vector<const node_type*> stack_;
+    };
+
+    TreeSnapshot() = default;
+
+    explicit TreeSnapshot(std::shared_ptr<const version_type> version)
+    : version_(std::move(version)) {}
+
+    const Value* Find(const Key& elem) const {
+        const node_type* cur_ptr = Root();
+        while (cur_ptr != nullptr) {
+            if (elem == cur_ptr->key) {
+                return &cur_ptr->value;
+            } else if (elem > cur_ptr->key) {
+                cur_ptr = cur_ptr->right.get();
+            } else {
+                cur_ptr = cur_ptr->left.get();
+            }
+        }
+        return nullptr;
+    }
+
+    bool Empty() const {
+        return Root() == nullptr;
+    }
+
+    size_t Size() const {
+        return version_ == nullptr ? 0 : version_->size;
+    }
+
+    Iterator begin() const {
+        return Iterator(Root());
+    }
+
+    Iterator end() const {
+        return Iterator();
+    }
+
+    // Параллельные обходы, см. Parallel::TreeReduce. Снимок не меняется,
+    // поэтому обход не мешает писателю.
+    template <typename T, typename Map, typename Reduce>
+    T ParallelReduce(T identity, Map map, Reduce reduce, Parallel::ThreadPool& pool = Parallel::ThreadPool::Instance()) const {
+        auto map_node = [&map] (const node_type* node) {
+            return map(std::pair<const Key&, const Value&>(node->key, node->value));
+        };
+        return Parallel::TreeReduce<const node_type>::Run(Root(), Size(), identity, map_node, reduce, pool);
+    }
+
+    template <typename Predicate>
+    size_t ParallelCountIf(Predicate predicate, Parallel::ThreadPool& pool = Parallel::ThreadPool::Instance()) const {
+        return ParallelReduce(size_t(0), [&predicate] (std::pair<const Key&, const Value&> pair) -> size_t {
+            return predicate(pair) ? 1 : 0;
+        }, [] (size_t lhs, size_t rhs) {
+            return lhs + rhs;
+        }, pool);
+    }
+
+private:
+    const node_type* Root() const {
+        return version_ == nullptr ? nullptr : version_->root.get();
+    }
+
+    std::shared_ptr<const version_type> version_;
+};
+
+// Изменения выполняются одним писателем, Snapshot() можно вызывать из
+// любых потоков параллельно с ним.
+template <typename Key, typename Value, typename Allocator = std::allocator<PersistentTreeNode<Key, Value>>>
+class PersistentTree {
+public:
+    using snapshot_type = TreeSnapshot<Key, Value, Allocator>;
+    using node_type = PersistentTreeNode<Key, Value>;
+    using node_ptr = typename node_type::node_ptr;
+    using allocator_type = typename snapshot_type::allocator_type;
+    using node_allocator_type = Allocators::AllocatorRef<node_type, allocator_type>;
+    using version_type = typename snapshot_type::version_type;
+
+    PersistentTree()
+    : allocator_(std::make_shared<allocator_type>()) {
+        Publish(nullptr, 0);
+    }
+
+    PersistentTree(const PersistentTree&) = delete;
+    PersistentTree(PersistentTree&&) = delete;
+
+    snapshot_type Snapshot() const {
+        return snapshot_type(std::atomic_load(&version_));
+    }
+
+    // Поиск в текущей версии без снимка. Указатель верен, пока писатель не
+    // удалит ключ, поэтому вызывать только из потока писателя; читателям
+    // нужен Snapshot().Find().
+    const Value* Find(const Key& elem) const {
+        const node_type* cur_ptr = version_->root.get();
+        while (cur_ptr != nullptr) {
+            if (elem == cur_ptr->key) {
+                return &cur_ptr->value;
+            }
+            cur_ptr = elem > cur_ptr->key ? cur_ptr->right.get() : cur_ptr->left.get();
+        }
+        return nullptr;
+    }
+
+    bool Empty() const {
+        return Snapshot().Empty();
+    }
+
+    size_t Size() const {
+        return Snapshot().Size();
+    }
+
+    void Insert(const Key& elem_key, const Value& elem_value) {
+        std::vector<std::pair<const node_type*, bool>> path;
+        const node_type* cur_ptr = version_->root.get();
+        while (cur_ptr != nullptr) {
+            bool right = elem_key >= cur_ptr->key;
+            path.emplace_back(cur_ptr, right);
+            cur_ptr = right ? cur_ptr->right.get() : cur_ptr->left.get();
+        }
+        Publish(Rebuild(path, MakeNode(elem_key, elem_value, nullptr, nullptr)), version_->size + 1);
+    }
+
+    bool Erase(const Key& elem) {
+        std::vector<std::pair<const node_type*, bool>> path;
+        const node_type* cur_ptr = version_->root.get();
+        while (cur_ptr != nullptr && !(elem == cur_ptr->key)) {
+            bool right = elem > cur_ptr->key;
+            path.emplace_back(cur_ptr, right);
+            cur_ptr = right ? cur_ptr->right.get() : cur_ptr->left.get();
+        }
+        if (cur_ptr == nullptr) {
+            return false;
+        }
+        node_ptr replacer;
+        if (cur_ptr->left == nullptr) {
+            replacer = cur_ptr->right;
+        } else if (cur_ptr->right == nullptr) {
+            replacer = cur_ptr->left;
+        } else {
+            // на место удаляемого встаёт минимальный узел правого поддерева
+            std::vector<std::pair<const node_type*, bool>> min_path;
+            const node_type* min_ptr = cur_ptr->right.get();
+            while (min_ptr->left != nullptr) {
+                min_path.emplace_back(min_ptr, false);
+                min_ptr = min_ptr->left.get();
+            }
+            node_ptr new_right = Rebuild(min_path, min_ptr->right);
+            replacer = MakeNode(min_ptr->key, min_ptr->value, cur_ptr->left, new_right);
+        }
+        Publish(Rebuild(path, replacer), version_->size - 1);
+        return true;
+    }
+
+private:
+    using version_allocator_type = Allocators::AllocatorRef<version_type, allocator_type>;
+
+    node_ptr MakeNode(const Key& key, const Value& value, node_ptr left, node_ptr right) {
+        return std::allocate_shared<node_type>(node_allocator_type(allocator_), key, value,
+                                               std::move(left), std::move(right));
+    }
+
+    // Копирует путь снизу вверх, подвешивая child вместо старого поддерева.
+    node_ptr Rebuild(const std::vector<std::pair<const node_type*, bool>>& path, node_ptr child) {
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            const node_type* node = it->first;
+            if (it->second) {
+                child = MakeNode(node->key, node->value, node->left, std::move(child));
+            } else {
+                child = MakeNode(node->key, node->value, std::move(child), node->right);
+            }
+        }
+        return child;
+    }
+
+    void Publish(node_ptr root, size_t size) {
+        std::shared_ptr<const version_type> version =
+                std::allocate_shared<version_type>(version_allocator_type(allocator_), version_type{std::move(root), size});
+        std::shared_ptr<const version_type> previous = std::atomic_exchange(&version_, std::move(version));
+        if (previous != nullptr) {
+            retired_.push_back(std::move(previous));
+        }
+        // новых ссылок на вытесненную версию уже не появится, поэтому
+        // use_count() == 1 значит, что её не держит ни один снимок
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                      [] (const std::shared_ptr<const version_type>& retired) {
+            return retired.use_count() == 1;
+        }), retired_.end());
+    }
+
+    std::shared_ptr<allocator_type> allocator_;
+    std::shared_ptr<const version_type> version_;
+    // вытесненные версии, которые ещё могут читать снимки
+    std::vector<std::shared_ptr<const version_type>> retired_;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Счётчики и гистограммы задержек. Точки замера расставляются макросами
+// STATS_TIMER и STATS_ADD; без FIGURE_STATS они раскрываются в пустоту и
+// ничего не стоят.
+namespace Stats {
+
+// Гистограмма с корзинами по степеням двойки наносекунд.
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 48;
+
+    void Record(uint64_t nanoseconds) {
+        size_t bucket = 0;
+        while (bucket + 1 < kBuckets && (nanoseconds >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t Count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // Верхняя граница корзины, в которую попал p-й процентиль (ближайший
+    // ранг ceil(p * n)), но не больше наибольшего замера.
+    uint64_t Percentile(double p) const {
+        uint64_t count = Count();
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * count));
+        rank = std::min(std::max<uint64_t>(rank, 1), count);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min((uint64_t(2) << i) - 1, max);
+            }
+        }
+        return max;
+    }
+
+    void Print(std::ostream& os) const {
+        uint64_t count = Count();
+        os << "count " << count
+           << " mean_ns " << (count == 0 ? 0 : total_.load(std::memory_order_relaxed) / count)
+           << " p50_ns " << Percentile(0.5)
+           << " p99_ns " << Percentile(0.99)
+           << " max_ns " << max_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+class Registry {
+public:
+    static Registry& Instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    Histogram& GetHistogram(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& result = histograms_[name];
+        if (result == nullptr) {
+            result = std::make_unique<Histogram>();
+        }
+        return *result;
+    }
+
+    std::atomic<int64_t>& GetCounter(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& result = counters_[name];
+        if (result == nullptr) {
+            result = std::make_unique<std::atomic<int64_t>>(0);
+        }
+        return *result;
+    }
+
+    void Print(std::ostream& os) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& counter : counters_) {
+            os << std::left << std::setw(24) << counter.first << " " << counter.second->load(std::memory_order_relaxed) << "\n";
+        }
+        for (auto& histogram : histograms_) {
+            os << std::left << std::setw(24) << histogram.first << " ";
+            histogram.second->Print(os);
+            os << "\n";
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+    std::map<std::string, std::unique_ptr<std::atomic<int64_t>>> counters_;
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+    : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        histogram_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer(ScopedTimer&&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Периодически перезаписывает файл текущей статистикой.
+class Exporter {
+public:
+    Exporter(const std::string& path, std::chrono::milliseconds interval, std::function<void(std::ostream&)> dump)
+    : path_(path), interval_(CheckInterval(interval)), dump_(std::move(dump)), thread_([this] { Loop(); }) {}
+
+    ~Exporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+        Export();
+    }
+
+    Exporter(const Exporter&) = delete;
+    Exporter(Exporter&&) = delete;
+
+private:
+    void Loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!wake_.wait_for(lock, interval_, [this] { return stop_; })) {
+            lock.unlock();
+            Export();
+            lock.lock();
+        }
+    }
+
+    static std::chrono::milliseconds CheckInterval(std::chrono::milliseconds interval) {
+        if (interval.count() <= 0) {
+            throw std::invalid_argument("Stats export interval must be positive");
+        }
+        return interval;
+    }
+
+    // Пишет во временный файл и подменяет им старый, чтобы читатель не
+    // увидел файл записанным наполовину.
+    void Export() {
+        std::string temp_path = path_ + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            dump_(file);
+            if (!file) {
+                return;
+            }
+        }
+        std::rename(temp_path.c_str(), path_.c_str());
+    }
+
+    std::string path_;
+    std::chrono::milliseconds interval_;
+    std::function<void(std::ostream&)> dump_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+}
+
+#define STATS_CONCAT_IMPL(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_IMPL(a, b)
+
+#ifdef FIGURE_STATS
+#define STATS_ENABLED 1
+#define STATS_TIMER(name) \
+    static Stats::Histogram& STATS_CONCAT(stats_histogram_, __LINE__) = Stats::Registry::Instance().GetHistogram(name); \
+    Stats::ScopedTimer STATS_CONCAT(stats_timer_, __LINE__)(STATS_CONCAT(stats_histogram_, __LINE__))
+#define STATS_ADD(name, value) \
+    do { \
+        static std::atomic<int64_t>& stats_counter = Stats::Registry::Instance().GetCounter(name); \
+        stats_counter.fetch_add(static_cast<int64_t>(value), std::memory_order_relaxed); \
+    } while (false)
+#else
+#define STATS_ENABLED 0
+#define STATS_TIMER(name) do {} while (false)
+#define STATS_ADD(name, value) do {} while (false)
+#endif
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+// Пул потоков с кражей задач: у каждого рабочего своя очередь, свои задачи
+// он берёт с конца, чужие крадёт с начала.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+
+    static ThreadPool& Instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t Size() const {
+        return workers_.size();
+    }
+
+    void Submit(std::function<void()> task) {
+        size_t index = current_pool_ == this
+                ? current_index_
+                : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            ++pending_;
+        }
+        wake_.notify_one();
+    }
+
+    // Выполняет одну задачу из пула, если она есть. Используется ожидающими
+    // потоками, чтобы не простаивать, пока выполняются их подзадачи.
+    bool RunPendingTask() {
+        std::function<void()> task;
+        size_t index = current_pool_ == this ? current_index_ : 0;
+        if (!Pop(index, task)) {
+            return false;
+        }
+        task();
+        return true;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool Pop(size_t index, std::function<void()>& task) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            if (!queues_[index]->tasks.empty()) {
+                task = std::move(queues_[index]->tasks.back());
+                queues_[index]->tasks.pop_back();
+                --pending_;
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            Queue& victim = *queues_[(index + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --pending_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+        std::function<void()> task;
+        while (true) {
+            if (Pop(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+            if (stop_) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<size_t> pending_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+    static inline thread_local ThreadPool* current_pool_ = nullptr;
+    static inline thread_local size_t current_index_ = 0;
+};
+
+// Группа задач fork-join. Wait() не блокирует поток, а помогает пулу,
+// поэтому вложенные группы не приводят к взаимной блокировке.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool)
+    : pool_(pool) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup(TaskGroup&&) = delete;
+
+    ~TaskGroup() {
+        while (pending_.load(std::memory_order_acquire) != 0) {
+            if (!pool_.RunPendingTask()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    template <typename Function>
+    void Run(Function function) {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        pool_.Submit([this, function]() mutable {
+            try {
+                function();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+            pending_.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void Wait() {
+        while (pending_.load(std::memory_order_acquire) != 0) {
+            if (!pool_.RunPendingTask()) {
+                std::this_thread::yield();
+            }
+        }
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+}
@@ -3,7 +3,15 @@
 #include <memory>
 #include <tuple>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <new>
+#include <type_traits>
 
+#include "AllocatorRef.h"
+#include "HashIndex.h"
+#include "TreeReduce.h"
 
 template <typename U, typename V>
 std::ostream& operator << (std::ostream& os, const std::vector<std::pair<U,V>>& v) {
@@ -142,45 +150,54 @@ class Tree {
 
     using iterator_type = TreeIterator<Key,Value,Allocator>;
     using node_type = TreeNode<Key, Value>;
-    using allocator_type = typename Allocator::template rebind<node_type>::other;
-
-
-    struct deleter {
-        deleter(allocator_type* allocator)
-        : allocator_(allocator) {}
-
-        void operator() (node_type* ptr) {
-            std::allocator_traits<allocator_type>::destroy(*allocator_, ptr);
-            allocator_->deallocate(ptr, 1);
-        }
-
-    private:
-        allocator_type* allocator_;
-    };
+    using allocator_type = typename Allocator::template rebind<char>::other;
+    using node_allocator_type = Allocators::AllocatorRef<node_type, allocator_type>;
+    // Индекс не владеет узлами: их держит дерево, а Erase убирает ключ из
+    // индекса до того, как узел умрёт.
+    using index_type = HashIndex<Key, node_type*, allocator_type>;
+    // Ключи без std::hash дерево принимает, как и раньше, но без индекса:
+    // код индекса для них не инстанцируется.
+    static constexpr bool kIndexable = IsHashable<Key>::value;
+
+    template <typename... Args>
+    std::shared_ptr<node_type> MakeNode(Args&&... args) {
+        return std::allocate_shared<node_type>(node_allocator_type(allocator_), std::forward<Args>(args)...);
+    }
 
 public:
 
     Tree() {
-        node_type* new_elem_raw = allocator_.allocate(1);
-        std::allocator_traits<allocator_type>::construct(allocator_, new_elem_raw);
-        terminator_ = std::shared_ptr<node_type>(new_elem_raw, deleter(&allocator_));
+        terminator_ = MakeNode();
     }
 
-    iterator_type Find(const Key& elem) {
-        if (Empty()) {
-            return end();
+    ~Tree() {
+        Clear();
+    }
+
+    // Включает хэш-индекс ключ -> узел, с которым Find работает за O(1).
+    // Индекс живёт в памяти аллокатора дерева и обновляется в Insert/Erase.
+    void EnableIndex() {
+        static_assert(kIndexable, "EnableIndex needs std::hash for the key type");
+        if (index_) {
+            return;
         }
-        std::shared_ptr<node_type> cur_ptr = terminator_->left;
-        while(cur_ptr != nullptr) {
-            if (elem == cur_ptr->key) {
-                return iterator_type(cur_ptr, this);
-            } else if (elem > cur_ptr->key) {
-                cur_ptr = cur_ptr->right;
-            } else if (elem < cur_ptr->key) {
-                cur_ptr = cur_ptr->left;
+        index_.emplace(allocator_);
+        for (auto it = begin(); it != end(); ++it) {
+            if (index_->Find((*it).first) == nullptr) {
+                index_->Insert((*it).first, FindNode((*it).first).get());
             }
         }
-        return end();
+    }
+
+    iterator_type Find(const Key& elem) {
+        if constexpr (kIndexable) {
+            if (index_) {
+                node_type** found = index_->Find(elem);
+                return found == nullptr ? end() : iterator_type(SharedNode(*found), this);
+            }
+        }
+        std::shared_ptr<node_type> result = FindNode(elem);
+        return result == nullptr ? end() : iterator_type(result, this);
     }
 
     iterator_type LowerBound(const Key& elem) {
@@ -209,12 +226,21 @@ public:
     }
 
     iterator_type Insert(const Key& elem_key, const Value& elem_value) {
+        if constexpr (kIndexable) {
+            if (index_) {
+                index_->Reserve(size_ + 1);
+            }
+        }
         if (Empty()) {
             // если пустое заменить корень
-            node_type* new_elem_raw = allocator_.allocate(1);
-            std::allocator_traits<allocator_type>::construct(allocator_, new_elem_raw, elem_key, elem_value);
-            terminator_->left = std::shared_ptr<node_type>(new_elem_raw, deleter(&allocator_));
+            terminator_->left = MakeNode(elem_key, elem_value);
             terminator_->left->parent = terminator_;
+            ++size_;
+            if constexpr (kIndexable) {
+                if (index_) {
+                    index_->Insert(elem_key, terminator_->left.get());
+                }
+            }
             return iterator_type(terminator_->left, this);
         }
         std::shared_ptr<node_type> cur_ptr = terminator_->left;
@@ -227,15 +253,20 @@ public:
                 break;
             }
         }
-        node_type* new_elem_raw = allocator_.allocate(1);
-        std::allocator_traits<allocator_type>::construct(allocator_, new_elem_raw, elem_key, elem_value);
-        std::shared_ptr<node_type> new_elem(new_elem_raw, deleter(&allocator_));
+        std::shared_ptr<node_type> new_elem = MakeNode(elem_key, elem_value);
         if (elem_key >= cur_ptr->key) {
             cur_ptr->right = new_elem;
         } else {
             cur_ptr->left = new_elem;
         }
         new_elem->parent = cur_ptr;
+        ++size_;
+        // при равных ключах Find находит верхний узел, он уже в индексе
+        if constexpr (kIndexable) {
+            if (index_ && index_->Find(elem_key) == nullptr) {
+                index_->Insert(elem_key, new_elem.get());
+            }
+        }
         return iterator_type(new_elem, this);
 
     }
@@ -256,6 +287,8 @@ public:
             throw std::logic_error("Use of deleted iterator");
         }
         std::shared_ptr<node_type> parent = cur_elem->parent.lock();
+        // узел, занявший место удаляемого: минимальный в правом поддереве
+        node_type* replacer_node = nullptr;
         if (cur_elem->right == nullptr) {
             if (cur_elem == parent->left) {
                 parent->left = cur_elem->left;
@@ -266,6 +299,7 @@ public:
                 cur_elem->left->parent = parent;
             }
         } else if (cur_elem->right->left == nullptr) {
+            replacer_node = cur_elem->right.get();
             cur_elem->right->left = cur_elem->left;
             if (cur_elem->left != nullptr) {
                 cur_elem->left->parent = cur_elem->right;
@@ -282,6 +316,7 @@ public:
             while (replacer->left != nullptr) {
                 replacer = replacer->left;
             }
+            replacer_node = replacer.get();
             replacer->parent.lock()->left = replacer->right;
             if (replacer->right != nullptr) {
                 replacer->right->parent = replacer->parent;
@@ -299,13 +334,92 @@ public:
                 parent->right = replacer;
             }
         }
+        --size_;
+        if constexpr (kIndexable) {
+            if (index_) {
+                node_type** indexed = index_->Find(cur_elem->key);
+                if (indexed != nullptr && *indexed == cur_elem.get()) {
+                    // равные ключи лежат только в правом поддереве верхнего
+                    // из них, так что следующий равный, если есть, и есть
+                    // минимальный узел этого поддерева
+                    if (replacer_node != nullptr && replacer_node->key == cur_elem->key) {
+                        *indexed = replacer_node;
+                    } else {
+                        index_->Erase(cur_elem->key);
+                    }
+                }
+            }
+        }
+
+    }
+
+    // Удаляет все узлы. Обход идёт по явному стеку: при рекурсивном
+    // освобождении через shared_ptr вырожденное дерево переполняет стек.
+    void Clear() {
+        if (index_) {
+            index_->Clear();
+        }
+        std::vector<std::shared_ptr<node_type>> stack;
+        if (terminator_->left != nullptr) {
+            stack.push_back(std::move(terminator_->left));
+        }
+        while (!stack.empty()) {
+            std::shared_ptr<node_type> node = std::move(stack.back());
+            stack.pop_back();
+            if (node->left != nullptr) {
+                stack.push_back(std::move(node->left));
+            }
+            if (node->right != nullptr) {
+                stack.push_back(std::move(node->right));
+            }
+        }
+        size_ = 0;
+    }
 
+    // Выбрасывает все узлы разом сбросом арены (Allocators::MonotonicArena),
+    // без обхода дерева и деструкторов. Итераторы и Find-результаты к этому
+    // моменту должны быть уничтожены: их счётчики лежат в памяти арены.
+    void Release() {
+        static_assert(std::is_trivially_destructible_v<Key> && std::is_trivially_destructible_v<Value>,
+                      "Release skips destructors, use Clear for such keys and values");
+        if (index_) {
+            index_->Abandon();
+        }
+        Abandon(terminator_);
+        allocator_->Reset();
+        terminator_ = MakeNode();
+        size_ = 0;
     }
 
     bool Empty() const {
         return terminator_->left == nullptr;
     }
 
+    size_t Size() const {
+        return size_;
+    }
+
+    // Высота дерева, считается обходом, поэтому только для диагностики.
+    size_t Depth() const {
+        size_t result = 0;
+        std::vector<std::pair<node_type*, size_t>> stack;
+        if (terminator_->left != nullptr) {
+            stack.emplace_back(terminator_->left.get(), 1);
+        }
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            result = std::max(result, depth);
+            if (node->left != nullptr) {
+                stack.emplace_back(node->left.get(), depth + 1);
+            }
+            if (node->right != nullptr) {
+                stack.emplace_back(node->right.get(), depth + 1);
+            }
+        }
+        return result;
+    }
+
     iterator_type begin() {
         std::shared_ptr<node_type> result = terminator_;
         while (result->left != nullptr) {
@@ -318,8 +432,66 @@ public:
         return iterator_type(terminator_, this);
     }
 
+    // Параллельные обходы, см. Parallel::TreeReduce. Во время обхода
+    // дерево не должно изменяться.
+    template <typename T, typename Map, typename Reduce>
+    T ParallelReduce(T identity, Map map, Reduce reduce, Parallel::ThreadPool& pool = Parallel::ThreadPool::Instance()) {
+        auto map_node = [&map] (node_type* node) {
+            return map(std::pair<const Key&, Value&>(node->key, node->value));
+        };
+        return Parallel::TreeReduce<node_type>::Run(terminator_->left.get(), size_, identity, map_node, reduce, pool);
+    }
+
+    template <typename Predicate>
+    size_t ParallelCountIf(Predicate predicate, Parallel::ThreadPool& pool = Parallel::ThreadPool::Instance()) {
+        return ParallelReduce(size_t(0), [&predicate] (std::pair<const Key&, Value&> pair) -> size_t {
+            return predicate(pair) ? 1 : 0;
+        }, [] (size_t lhs, size_t rhs) {
+            return lhs + rhs;
+        }, pool);
+    }
+
+    template <typename Function>
+    void ParallelForEach(Function function, Parallel::ThreadPool& pool = Parallel::ThreadPool::Instance()) {
+        ParallelReduce(false, [&function] (std::pair<const Key&, Value&> pair) {
+            function(pair);
+            return false;
+        }, [] (bool, bool) {
+            return false;
+        }, pool);
+    }
+
 
 private:
-    allocator_type allocator_;
+    // Забывает указатель, не трогая счётчик ссылок: узлы не освобождаются
+    // по одному, их память вернёт сброс арены.
+    static void Abandon(std::shared_ptr<node_type>& ptr) {
+        alignas(std::shared_ptr<node_type>) unsigned char storage[sizeof(std::shared_ptr<node_type>)];
+        new (storage) std::shared_ptr<node_type>(std::move(ptr));
+    }
+
+    // Владеющий указатель на узел хранится в ссылке из родителя.
+    std::shared_ptr<node_type> SharedNode(node_type* node) {
+        std::shared_ptr<node_type> parent = node->parent.lock();
+        return parent->left.get() == node ? parent->left : parent->right;
+    }
+
+    std::shared_ptr<node_type> FindNode(const Key& elem) {
+        std::shared_ptr<node_type> cur_ptr = terminator_->left;
+        while(cur_ptr != nullptr) {
+            if (elem == cur_ptr->key) {
+                return cur_ptr;
+            } else if (elem > cur_ptr->key) {
+                cur_ptr = cur_ptr->right;
+            } else if (elem < cur_ptr->key) {
+                cur_ptr = cur_ptr->left;
+            }
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<allocator_type> allocator_ = std::make_shared<allocator_type>();
     std::shared_ptr<node_type> terminator_ = nullptr;
+    size_t size_ = 0;
+    std::optional<index_type> index_;
 };
\ No newline at end of file
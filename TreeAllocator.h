@@ -1,10 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include "Tree.h"
+#include "Stats.h"
 
 namespace Allocators {
 
+// Печать списков блоков после каждого allocate/deallocate. Сервер её
+// выключает: вывод синхронный и шёл бы под блокировкой записи хранилища.
+inline std::atomic<bool> trace_allocations(true);
+
 template <typename T, size_t MEM_SIZE>
 class TreeAllocator {
 public:
@@ -31,6 +37,7 @@ public:
     TreeAllocator(TreeAllocator &&) = delete;
 
     T* allocate(size_t alloc_size) {
+        STATS_TIMER("allocator.allocate");
         if (alloc_size == 0) {
             throw std::logic_error("Allocation of 0 bytes");
         }
@@ -40,6 +47,7 @@ public:
             ++iter;
         }
         if (iter == free_blocks_.end()) {
+            STATS_ADD("allocator.failures", 1);
             throw std::bad_alloc();
         }
         char* block_ptr = (*iter).first;
@@ -52,17 +60,24 @@ public:
             free_blocks_.Insert(block_ptr + alloc_size, block_size - alloc_size);
             busy_blocks_.Insert(block_ptr, alloc_size);
         }
-        Print();
+        STATS_ADD("allocator.allocations", 1);
+        STATS_ADD("allocator.bytes_busy", alloc_size);
+        if (trace_allocations.load(std::memory_order_relaxed)) {
+            Print();
+        }
         return (T*)block_ptr;
     }
 
     void deallocate(T* ptr, size_t size) {
+        STATS_TIMER("allocator.deallocate");
         size *= sizeof(T);
         auto iter = busy_blocks_.Find((char*)ptr);
         if (iter == busy_blocks_.end() || size != (*iter).second) {
             throw std::logic_error("Wrong ptr to deallocate");
         }
         busy_blocks_.Erase(iter);
+        STATS_ADD("allocator.deallocations", 1);
+        STATS_ADD("allocator.bytes_busy", -static_cast<int64_t>(size));
 
         auto deallocated_iter = free_blocks_.Insert((char*) ptr, size);
         if (deallocated_iter != free_blocks_.begin()) {
@@ -85,10 +100,13 @@ public:
             }
         }
 
-        Print();
+        if (trace_allocations.load(std::memory_order_relaxed)) {
+            Print();
+        }
     }
 
     void Print() {
+        STATS_TIMER("allocator.print");
         std::cout << "free\n";
         for (auto pair : free_blocks_) {
             std::cout << "(" << pair.second << ") ";
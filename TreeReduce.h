@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace Parallel {
+
+// Параллельная свёртка двоичного дерева поиска, общая для Tree и
+// TreeSnapshot. Узлу нужны только поля left и right (умные указатели),
+// map получает указатель на узел, reduce должна быть ассоциативной.
+//
+// Дерево делится на поддеревья: правые поддеревья верхних уровней
+// отдаются пулу, нижние уровни обходятся последовательно. Деревья не
+// балансируются, и ключи по возрастанию дают цепочку, которую на
+// поддеревья не разделить. Тогда узлы перебирает вызывающий поток и отдаёт
+// пулу пачками: параллельно считаются только map и reduce. Маленькие
+// деревья обходятся без пула. Во время обхода дерево не должно изменяться.
+template <typename Node>
+class TreeReduce {
+public:
+    static constexpr size_t kChunkSize = 1024;
+
+    // Дешёвая проверка формы: крайние пути не длиннее 2*log2(size) + 2.
+    // Перекос внутри дерева она не замечает, но цепочку от упорядоченных
+    // ключей находит за O(log n).
+    static bool Balanced(const Node* root, size_t size) {
+        size_t limit = 2;
+        for (size_t count = size; count > 1; count /= 2) {
+            limit += 2;
+        }
+        for (bool right : {false, true}) {
+            size_t length = 0;
+            for (const Node* cur_ptr = root; cur_ptr != nullptr; ++length) {
+                if (length > limit) {
+                    return false;
+                }
+                cur_ptr = right ? cur_ptr->right.get() : cur_ptr->left.get();
+            }
+        }
+        return true;
+    }
+
+    template <typename T, typename Map, typename Reduce>
+    static T Run(Node* root, size_t size, T identity, Map& map, Reduce& reduce, ThreadPool& pool) {
+        if (size < kChunkSize) {
+            return Sequential(root, identity, map, reduce);
+        }
+        if (!Balanced(root, size)) {
+            return Chunked(root, identity, map, reduce, pool);
+        }
+        size_t split_depth = 2;
+        for (size_t threads = pool.Size(); threads > 1; threads /= 2) {
+            ++split_depth;
+        }
+        return Subtree(root, split_depth, identity, map, reduce, pool);
+    }
+
+private:
+    template <typename T, typename Map, typename Reduce>
+    static T Sequential(Node* node, const T& identity, Map& map, Reduce& reduce) {
+        T result = identity;
+        std::vector<Node*> stack;
+        Node* cur_ptr = node;
+        while (cur_ptr != nullptr || !stack.empty()) {
+            while (cur_ptr != nullptr) {
+                stack.push_back(cur_ptr);
+                cur_ptr = cur_ptr->left.get();
+            }
+            cur_ptr = stack.back();
+            stack.pop_back();
+            result = reduce(result, map(cur_ptr));
+            cur_ptr = cur_ptr->right.get();
+        }
+        return result;
+    }
+
+    template <typename T, typename Map, typename Reduce>
+    static T Chunked(Node* root, const T& identity, Map& map, Reduce& reduce, ThreadPool& pool) {
+        // deque не перемещает элементы при push_back, задачи держат ссылки
+        std::deque<std::vector<Node*>> chunks;
+        std::deque<T> results;
+        TaskGroup group(pool);
+        auto submit = [&] {
+            results.push_back(identity);
+            std::vector<Node*>& chunk = chunks.back();
+            T& result = results.back();
+            group.Run([&chunk, &result, &map, &reduce] {
+                for (Node* node : chunk) {
+                    result = reduce(result, map(node));
+                }
+            });
+        };
+        std::vector<Node*> stack;
+        Node* cur_ptr = root;
+        chunks.emplace_back();
+        while (cur_ptr != nullptr || !stack.empty()) {
+            while (cur_ptr != nullptr) {
+                stack.push_back(cur_ptr);
+                cur_ptr = cur_ptr->left.get();
+            }
+            cur_ptr = stack.back();
+            stack.pop_back();
+            chunks.back().push_back(cur_ptr);
+            if (chunks.back().size() == kChunkSize) {
+                submit();
+                chunks.emplace_back();
+            }
+            cur_ptr = cur_ptr->right.get();
+        }
+        if (!chunks.back().empty()) {
+            submit();
+        }
+        group.Wait();
+        T result = identity;
+        for (const T& part : results) {
+            result = reduce(result, part);
+        }
+        return result;
+    }
+
+    template <typename T, typename Map, typename Reduce>
+    static T Subtree(Node* node, size_t split_depth, const T& identity,
+                     Map& map, Reduce& reduce, ThreadPool& pool) {
+        if (node == nullptr) {
+            return identity;
+        }
+        if (split_depth == 0) {
+            return Sequential(node, identity, map, reduce);
+        }
+        T right_result = identity;
+        TaskGroup group(pool);
+        if (node->right != nullptr) {
+            group.Run([&] {
+                right_result = Subtree(node->right.get(), split_depth - 1, identity, map, reduce, pool);
+            });
+        }
+        T result = Subtree(node->left.get(), split_depth - 1, identity, map, reduce, pool);
+        result = reduce(result, map(node));
+        group.Wait();
+        return reduce(result, right_result);
+    }
+};
+
+}
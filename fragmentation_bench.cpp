@@ -0,0 +1,139 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "CompactingPool.h"
+#include "HandleTree.h"
+#include "Square.h"
+
+// Нагрузка с чередованием выделений и освобождений для CompactingPool:
+// метрики фрагментации до уплотнения, по шагам и после него. Вторая часть
+// проверяет, что HandleTree с квадратами переживает полное уплотнение.
+
+using Pool = Allocators::CompactingPool<1 << 18>;
+
+void PrintMetrics(const char* title, Pool& pool) {
+    std::cout << std::left << std::setw(22) << title
+              << " free " << std::setw(8) << pool.FreeBytes()
+              << " blocks " << std::setw(6) << pool.FreeBlocks()
+              << " largest " << std::setw(8) << pool.LargestFreeBlock()
+              << " fragmentation " << std::fixed << std::setprecision(3) << pool.Fragmentation() << "\n";
+}
+
+Square<int> MakeSquare(int side) {
+    return Square<int>({0, 0}, {0, side}, {side, 0}, {side, side});
+}
+
+// Узлы дерева вперемешку с блоками-заполнителями; после освобождения
+// заполнителей и половины ключей пул раздроблен, Compact() переносит узлы,
+// а дерево должно остаться прежним.
+bool TreeWorkload() {
+    Pool pool;
+    HandleTree<int, Square<int>, 1 << 18> figures(pool);
+    std::mt19937 gen(7);
+    std::vector<Pool::handle_type> fillers;
+    int count = 0;
+    try {
+        while (true) {
+            fillers.push_back(pool.Allocate(16 + gen() % 240));
+            figures.Insert(count, MakeSquare(1 + count % 100));
+            ++count;
+        }
+    } catch (std::bad_alloc&) {
+    }
+    for (auto handle : fillers) {
+        pool.Free(handle);
+    }
+    for (int key = 0; key < count; key += 2) {
+        figures.Erase(key);
+    }
+    PrintMetrics("tree before compaction", pool);
+    pool.Compact(Pool::Size());
+    PrintMetrics("tree after compaction", pool);
+
+    int expected = 1;
+    bool intact = true;
+    figures.ForEach([&expected, &intact] (int key, const Square<int>& figure) {
+        int side = 1 + key % 100;
+        intact = intact && key == expected && figure.Area() == double(side) * side;
+        expected += 2;
+    });
+    intact = intact && figures.Size() == static_cast<size_t>(count / 2);
+    std::cout << "tree of " << figures.Size() << " figures " << (intact ? "intact" : "corrupted")
+              << " after compaction\n";
+    return intact;
+}
+
+int main() {
+    Pool pool;
+    std::mt19937 gen(42);
+    std::vector<Pool::handle_type> live;
+
+    // Выделяет блок, только если он помещается в одну из дыр, чтобы
+    // нагрузка не запускала уплотнение сама.
+    auto allocate = [&pool, &gen, &live] () {
+        size_t size = 16 + gen() % 240;
+        if (size > pool.LargestFreeBlock()) {
+            throw std::bad_alloc();
+        }
+        Pool::handle_type handle = pool.Allocate(size);
+        *pool.Get<uint32_t>(handle) = handle;
+        live.push_back(handle);
+    };
+    auto free_random = [&pool, &gen, &live] () {
+        size_t index = gen() % live.size();
+        pool.Free(live[index]);
+        live[index] = live.back();
+        live.pop_back();
+    };
+
+    try {
+        while (true) {
+            allocate();
+        }
+    } catch (std::bad_alloc&) {
+    }
+    for (int round = 0; round < 20000; ++round) {
+        free_random();
+        try {
+            allocate();
+        } catch (std::bad_alloc&) {
+        }
+    }
+    for (size_t i = live.size() / 2; i > 0; --i) {
+        free_random();
+    }
+    PrintMetrics("after churn", pool);
+
+    size_t large = pool.LargestFreeBlock() + Pool::kAlign;
+    std::cout << "large request " << large << " bytes would "
+              << (large <= pool.FreeBytes() ? "fit in total free space but no single block" : "not fit") << "\n";
+
+    size_t steps = 0;
+    size_t moved = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (pool.FreeBlocks() > 1) {
+        moved += pool.Compact(16 * 1024);
+        ++steps;
+        if (steps == 1 || steps == 4 || steps == 16) {
+            std::string title = "after " + std::to_string(steps) + " step(s)";
+            PrintMetrics(title.c_str(), pool);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintMetrics("after compaction", pool);
+    std::cout << "steps " << steps << " moved " << moved << " bytes in " << elapsed << " ms\n";
+
+    for (auto handle : live) {
+        if (*pool.Get<uint32_t>(handle) != handle) {
+            std::cout << "data corrupted after compaction\n";
+            return 1;
+        }
+    }
+    Pool::handle_type handle = pool.Allocate(large);
+    std::cout << "large request " << large << " bytes allocated\n";
+    pool.Free(handle);
+    return TreeWorkload() ? 0 : 1;
+}
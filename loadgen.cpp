@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Нагрузочный клиент для oop_exercise_06 --server.
+// Использование: figure_loadgen <socket> [connections] [requests] [pipeline] [write_percent] [keys]
+// Ключи add/erase берутся из общего диапазона [0, keys). Он должен помещаться
+// в пул хранилища, иначе add меряют ветку bad_alloc; такие ответы
+// считаются отдельно как failed writes.
+
+using Clock = std::chrono::steady_clock;
+
+int Connect(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw std::runtime_error("Cannot connect to " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+struct ClientResult {
+    std::vector<double> latencies;
+    size_t adds = 0;
+    size_t duplicate_adds = 0;
+    size_t failed_adds = 0;
+};
+
+std::string Request(std::mt19937& gen, int keys, int write_percent, bool& is_add) {
+    int key = static_cast<int>(gen() % keys);
+    is_add = false;
+    if (static_cast<int>(gen() % 100) < write_percent) {
+        if (gen() % 2 == 0) {
+            is_add = true;
+            int side = 1 + static_cast<int>(gen() % 10);
+            return "add " + std::to_string(key) + " 0 0 0 " + std::to_string(side) + " "
+                   + std::to_string(side) + " 0 " + std::to_string(side) + " " + std::to_string(side) + "\n";
+        }
+        return "erase " + std::to_string(key) + "\n";
+    }
+    switch (gen() % 3) {
+        case 0:
+            return "size\n";
+        case 1:
+            return "count " + std::to_string(1 + gen() % 100) + "\n";
+        default:
+            return "print\n";
+    }
+}
+
+void Client(const std::string& path, int id, size_t requests, size_t pipeline, int write_percent, int keys,
+            ClientResult& result) {
+    int fd = Connect(path);
+    std::mt19937 gen(id);
+    std::string buffer;
+    char chunk[65536];
+    for (size_t sent = 0; sent < requests; sent += pipeline) {
+        size_t batch = std::min(pipeline, requests - sent);
+        std::string out;
+        std::vector<bool> adds(batch);
+        for (size_t i = 0; i < batch; ++i) {
+            bool is_add;
+            out += Request(gen, keys, write_percent, is_add);
+            adds[i] = is_add;
+        }
+        Clock::time_point start = Clock::now();
+        for (size_t written = 0; written < out.size(); ) {
+            ssize_t count = send(fd, out.data() + written, out.size() - written, MSG_NOSIGNAL);
+            if (count <= 0) {
+                throw std::runtime_error("Connection lost");
+            }
+            written += count;
+        }
+        size_t received = 0;
+        while (received < batch) {
+            ssize_t count = read(fd, chunk, sizeof(chunk));
+            if (count <= 0) {
+                throw std::runtime_error("Connection lost");
+            }
+            buffer.append(chunk, count);
+            size_t pos;
+            while ((pos = buffer.find('\n')) != std::string::npos) {
+                if (adds[received]) {
+                    ++result.adds;
+                    if (buffer.compare(0, pos, "Element with such key already exists") == 0) {
+                        ++result.duplicate_adds;
+                    } else if (buffer.compare(0, std::strlen("Квадрат"), "Квадрат") != 0) {
+                        ++result.failed_adds;
+                    }
+                }
+                buffer.erase(0, pos + 1);
+                ++received;
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            }
+        }
+    }
+    close(fd);
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket> [connections] [requests] [pipeline] [write_percent] [keys]\n";
+        return 1;
+    }
+    std::string path = argv[1];
+    size_t connections = argc > 2 ? std::stoul(argv[2]) : 8;
+    size_t requests = argc > 3 ? std::stoul(argv[3]) : 10000;
+    size_t pipeline = argc > 4 ? std::max<size_t>(1, std::stoul(argv[4])) : 16;
+    int write_percent = argc > 5 ? std::stoi(argv[5]) : 10;
+    int keys = argc > 6 ? std::max(1, std::stoi(argv[6])) : 16;
+
+    std::vector<ClientResult> results(connections);
+    std::vector<std::thread> clients;
+    std::atomic<bool> failed(false);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < connections; ++i) {
+        clients.emplace_back([&, i] {
+            try {
+                Client(path, static_cast<int>(i), requests, pipeline, write_percent, keys, results[i]);
+            } catch (std::exception& ex) {
+                std::cerr << ex.what() << "\n";
+                failed = true;
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    size_t adds = 0;
+    size_t duplicate_adds = 0;
+    size_t failed_adds = 0;
+    for (auto& part : results) {
+        all.insert(all.end(), part.latencies.begin(), part.latencies.end());
+        adds += part.adds;
+        duplicate_adds += part.duplicate_adds;
+        failed_adds += part.failed_adds;
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << "requests " << all.size() << "\n"
+              << "ops/sec  " << static_cast<size_t>(all.size() / seconds) << "\n"
+              << "p50 us   " << Percentile(all, 0.50) << "\n"
+              << "p99 us   " << Percentile(all, 0.99) << "\n"
+              << "adds     " << adds << " (" << duplicate_adds << " duplicate, " << failed_adds << " failed)\n";
+    if (failed_adds != 0) {
+        std::cerr << "warning: some adds failed, the key range is larger than the store's pool\n";
+    }
+    return failed ? 1 : 0;
+}
@@ -5,66 +5,96 @@
 #include <iostream>
 #include <algorithm>
 #include <list>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
 
 #include "List.h"
 #include "Square.h"
 #include "Tree.h"
 #include "TreeAllocator.h"
+#include "FigureStore.h"
+#include "FigureServer.h"
+#include "MappedFigureStore.h"
+#include "Stats.h"
 
 
+std::atomic<bool> stop_server(false);
 
-int main() {
+void StopServer(int) {
+    stop_server = true;
+}
+
+// Фигуры в отображённом файле: набор переживает перезапуск программы.
+// Команды те же, что в обычном режиме.
+int RunMapped(const std::string& path) {
+    MappedFigureStore figures(path);
+    if (figures.Recovered()) {
+        std::cout << "Recovered after crash, " << figures.Size() << " figures\n";
+    }
     std::string command;
-    Tree<int, Square<int>*, Allocators::TreeAllocator<Square<int>, 1000>> figures;
     while (std::cin >> command) {
-        if (command == "add") {
-            int key;
-            std::cin >> key;
-            if (figures.Find(key) != figures.end()) {
-                std::cout << "Element with such key already exists\n";
-                continue;
-            }
-            Square<int>* new_figure = new Square<int>;
+        ExecuteFigureCommand(figures, command, std::cin, std::cout);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--mapped") == 0) {
             try {
-                std::cin >> *new_figure;
-                figures.Insert(key, new_figure);
-                std::cout << *new_figure << "\n";
+                return RunMapped(argv[i + 1]);
             } catch (std::exception& ex) {
-                std::cout << ex.what() << "\n";
+                std::cerr << ex.what() << "\n";
+                return 1;
             }
-        } else if (command == "erase") {
-            int key;
-            std::cin >> key;
-            auto it = figures.Find(key);
-            if (it != figures.end()) {
-                delete (*it).second;
-                figures.Erase(figures.Find(key));
-            } else {
-                std::cout << "No such element in container\n";
-            }
-        } else if (command == "size") {
-            size_t size = 0;
-            for (auto i : figures) {
-                size++;
+        }
+    }
+    std::string server_path;
+    std::string stats_path;
+    long stats_interval = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--server") == 0) {
+            server_path = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--stats-file") == 0) {
+            stats_path = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--stats-interval") == 0) {
+            char* end;
+            stats_interval = std::strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || stats_interval <= 0) {
+                std::cerr << "--stats-interval expects a positive number of seconds\n";
+                return 1;
             }
-            std::cout << size << "\n";
-        } else if (command == "count") {
-            size_t required_area;
-            std::cin >> required_area;
-            std::cout << std::count_if(figures.begin(), figures.end(), [&required_area] (auto fig) {
-                return fig.second->Area() < required_area;
-            });
-        } else if (command == "print") {
-            std::for_each(figures.begin(), figures.end(), [] (auto pair) {
-                std::cout << "(" << pair.first << ", " << *(pair.second) << ") ";
-            });
-        } else {
-            std::cout << "Incorrect command\n";
-            std::cin.ignore(32767, '\n');
         }
     }
-    for (auto i : figures) {
-        delete i.second;
+    if (!server_path.empty()) {
+        Allocators::trace_allocations = false;
+    }
+    FigureStore figures;
+    std::unique_ptr<Stats::Exporter> exporter;
+    if (!stats_path.empty()) {
+        exporter = std::make_unique<Stats::Exporter>(stats_path, std::chrono::seconds(stats_interval),
+                                                     [&figures] (std::ostream& os) {
+            figures.PrintStats(os);
+        });
+    }
+    if (!server_path.empty()) {
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+        try {
+            FigureServer server(figures, server_path);
+            server.Run(stop_server);
+        } catch (std::exception& ex) {
+            std::cerr << ex.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    std::string command;
+    while (std::cin >> command) {
+        figures.Execute(command, std::cin, std::cout);
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "PersistentTree.h"
+
+// Один писатель меняет PersistentTree, три читателя параллельно обходят
+// снимки. Собирать с -fsanitize=thread: гонка между освобождением версии
+// писателем и чтением снимка видна именно там. В конце все снимки отпущены,
+// и в аллокаторе должны остаться только узлы текущей версии и она сама.
+
+std::atomic<long> live_blocks(0);
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    template <class V>
+    struct rebind {
+        using other = CountingAllocator<V>;
+    };
+
+    CountingAllocator() = default;
+
+    template <class V>
+    CountingAllocator(const CountingAllocator<V>&) {}
+
+    T* allocate(size_t count) {
+        ++live_blocks;
+        return std::allocator<T>().allocate(count);
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        --live_blocks;
+        std::allocator<T>().deallocate(ptr, count);
+    }
+};
+
+using StressTree = PersistentTree<int, int, CountingAllocator<PersistentTreeNode<int, int>>>;
+
+bool Check(bool condition, const char* message) {
+    if (!condition) {
+        std::cout << "FAILED: " << message << "\n";
+    }
+    return condition;
+}
+
+int main() {
+    const int kOperations = 20000;
+    const int kReaders = 3;
+    std::atomic<bool> done(false);
+    std::atomic<bool> failed(false);
+    StressTree tree;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; ++r) {
+        readers.emplace_back([&] {
+            long snapshots = 0;
+            while (!done) {
+                auto snapshot = tree.Snapshot();
+                size_t count = 0;
+                bool first = true;
+                int previous = 0;
+                for (auto pair : snapshot) {
+                    // ключи снимка упорядочены, значение — квадрат ключа
+                    if ((!first && pair.first < previous) || pair.second != pair.first * pair.first) {
+                        failed = true;
+                    }
+                    first = false;
+                    previous = pair.first;
+                    ++count;
+                }
+                if (count != snapshot.Size()) {
+                    failed = true;
+                }
+                ++snapshots;
+            }
+            if (snapshots == 0) {
+                failed = true;
+            }
+        });
+    }
+    std::mt19937 gen(31);
+    for (int i = 0; i < kOperations; ++i) {
+        int key = gen() % 512;
+        if (gen() % 2 == 0 || !tree.Erase(key)) {
+            tree.Insert(key, key * key);
+        }
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    bool ok = Check(!failed, "a reader saw an inconsistent snapshot");
+
+    // последнее изменение освобождает версии, отпущенные читателями
+    tree.Insert(-1, 1);
+    ok = Check(live_blocks == static_cast<long>(tree.Size()) + 1, "superseded versions were not freed") && ok;
+    std::cout << (ok ? "OK" : "FAILED") << ", " << tree.Size() << " keys, " << live_blocks << " live blocks\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+
+#include "Tree.h"
+
+// Случайные вставки и удаления с повторяющимися ключами в двух одинаковых
+// деревьях, с хэш-индексом и без него, сверяются с std::multimap. Find с
+// индексом обязан вернуть тот же узел, что и спуск от корня. Собирать с
+// -fsanitize=address: индекс хранит сырые указатели на узлы.
+
+using IndexedTree = Tree<int, int, std::allocator<int>>;
+
+int main() {
+    const int kOperations = 50000;
+    IndexedTree indexed;
+    IndexedTree plain;
+    indexed.EnableIndex();
+    std::multimap<int, int> expected;
+    std::mt19937 gen(33);
+    for (int i = 0; i < kOperations; ++i) {
+        int key = gen() % 256;
+        if (gen() % 3 != 0) {
+            indexed.Insert(key, i);
+            plain.Insert(key, i);
+            expected.emplace(key, i);
+        } else if (expected.count(key) != 0) {
+            auto indexed_it = indexed.Find(key);
+            auto plain_it = plain.Find(key);
+            int value = (*indexed_it).second;
+            if ((*plain_it).second != value) {
+                std::cout << "FAILED: index points to another node of key " << key << "\n";
+                return EXIT_FAILURE;
+            }
+            for (auto it = expected.lower_bound(key); ; ++it) {
+                if (it->second == value) {
+                    expected.erase(it);
+                    break;
+                }
+            }
+            indexed.Erase(indexed_it);
+            plain.Erase(plain_it);
+        }
+        int probe = gen() % 256;
+        auto found = indexed.Find(probe);
+        bool present = expected.count(probe) != 0;
+        if ((found != indexed.end()) != present || (present && (*found).first != probe)) {
+            std::cout << "FAILED: Find(" << probe << ") disagrees with std::multimap\n";
+            return EXIT_FAILURE;
+        }
+    }
+    if (indexed.Size() != expected.size()) {
+        std::cout << "FAILED: size " << indexed.Size() << ", expected " << expected.size() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "OK, " << indexed.Size() << " elements\n";
+    return EXIT_SUCCESS;
+}